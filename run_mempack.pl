@@ -20,6 +20,8 @@ use FindBin;
 use lib "$FindBin::Bin/lib";
 use Round qw(:all);
 use Getopt::Long;
+use File::Temp qw(tempdir);
+use File::Spec;
 
 ## NCBI / Database paths - these need to be set!
 my $ncbidir = '';
@@ -40,12 +42,15 @@ my $format = 1;
 my $cores = 1;
 my $erase_previous = 0;
 my $draw_rr_contacts = 1;
+my $cascade = 0;
+my $recall = 0.99;
+my $render = 0;
 
 my (@mtx,$blast_out,$svm_all,%range,$header);
 my ($system);
 my %topology = ();
 
-my ($sequence,@topology,%profile,@empty,$topology_string,$length,%aa,%aa3,@all_contact);
+my ($sequence,@topology,%profile,@empty,$topology_string,$length,%aa,%aa3);
 my $window = 7;
 my $dp = 0.0001;
 my $verbose = 0;
@@ -123,6 +128,15 @@ sub main{
 
 	&load_mtx($header);
 
+	# Results already exist, just draw them
+	if ($render){
+		my $output = $output_path.$header."_CONTACT_DEF".$def.".results";
+		die "Couldn't open $output\n" unless -e $output;
+		my ($pred_hh,$predicted_contact) = &read_contact_results($output);
+		&draw_layout($output,$output_path.$header."_graph.out",$pred_hh,$predicted_contact);
+		exit;
+	}
+
 ## Predict lipid exposure
 
 	my $input_file = $input_path.$header."_LIPID_EXP.dat";
@@ -238,27 +252,6 @@ sub main{
 
 	$input_file = $input_path.$header."_CONTACT.dat";
 
-	$helix1_count = 1;
-	for (my $h = 0; $h < scalar @topology; $h+=2){
-		## Loop through all positions in this helix
-		my $helix1_pos = 1;
-		for my $p1 ($topology[$h]..$topology[$h+1]){
-			## Loop through all the helices after current one
-			my $helix2_count = $helix1_count + 1;
-			for (my $nh = $h+2; $nh < scalar @topology; $nh+=2){
-				my $helix2_pos = 1;
-				for my $p2 ($topology[$nh]..$topology[$nh+1]){
-					my $tmp_res = $p1."-".$p2;
-					push @all_contact,$tmp_res;
-					$helix2_pos++;
-				}
-				$helix2_count++;
-			}
-			$helix1_pos++;
-		}
-		$helix1_count++;
-	}
-
 	if (!-e $input_file){
 
 	open (INPUT,">$input_file");
@@ -421,12 +414,16 @@ sub main{
 	my $output = $output_path.$header."_CONTACT_DEF1.results";
 	my $graph_out = $output_path.$header."_graph.out";
 
+	my $prefilter = $model_path."CONTACT_PREFILTER_DEF1.model";
+
 	if($def == 3){
 		$model = $model_path."CONTACT_ALL_DEF3.model";
+		$prefilter = $model_path."CONTACT_PREFILTER_DEF3.model";
 		$prediction = $output_path.$header."_CONTACT_DEF3.predictions";
 		$output = $output_path.$header."_CONTACT_DEF3.results";
 	}elsif($def == 2){
 		$model = $model_path."CONTACT_ALL_DEF2.model";
+		$prefilter = $model_path."CONTACT_PREFILTER_DEF2.model";
 		$prediction = $output_path.$header."_CONTACT_DEF2.predictions";
 		$output = $output_path.$header."_CONTACT_DEF2.results";
 	}
@@ -434,6 +431,15 @@ sub main{
 	if (-e $model){
 		if (-e $prediction){
 			print "$prediction exists!\n\n";
+		}elsif($cascade){
+			die "$prefilter doesn't exist, run make prefilter_models.\n" unless -e $prefilter;
+			# Cheap first stage rejects confident non-contacts, survivors go to the full model
+			print "$svm_classify -v 1 -p $prefilter -r $recall $input_file $model $prediction\n";
+			$system = `$svm_classify -v 1 -p $prefilter -r $recall $input_file $model $prediction`;
+			foreach my $line (split(/\n/,$system)){
+				print "$line\n" if $line =~ /^Cascade/;
+			}
+			print "\n";
 		}else{
 			print "$svm_classify -v 0 $input_file $model $prediction\n";
 			$system = `$svm_classify -v 0 $input_file $model $prediction`;
@@ -444,36 +450,18 @@ sub main{
 
 ## Construct results file
 
-	my %residue_to_helix;
-
-	my $helix = 1;
-	for (my $h = 0;$h < scalar @topology; $h += 2){
-		my $r_start = $topology[$h];
-		my $r_stop = $topology[$h+1]+1;
-		for my $r ($r_start..$r_stop){
-			$residue_to_helix{$r} = $helix;
-		}
-		$helix++;
-	}
-
-	my %contact_scores;
+	# Only the positive residue pairs are kept in memory, and only if
+	# they are going to be drawn
+	my $keep_contacts = $graphics && $draw_rr_contacts;
 	my @predicted_contact = ();
 	my %pred_hh;
 
 	if (-e $output){
 
 		print "$output exists!\n\n";
-		unless(open(OUTPUT,$output)){
-			die "Couldn't open $output\n";
-		}else{
-			while(<OUTPUT>){
-				next if $_ =~ /Topology/;
-				my @split = split(/\s+/,$_);
-				push @predicted_contact,$split[0];
-				$pred_hh{$split[1]} = 1;
-			}
-			close OUTPUT;
-		}
+		my ($pred_hh,$predicted_contact) = &read_contact_results($output);
+		%pred_hh = %{$pred_hh};
+		@predicted_contact = @{$predicted_contact};
 	}else{
 
 		open(OUT,">$output");
@@ -489,22 +477,30 @@ sub main{
 		unless(open(CONTACT,$prediction)){
 			die "Couldn't open $prediction\n";
 		}else{
-			my $count = 0;
-			while(<CONTACT>){
-				my $value = $_;
-				$value =~ s/\s+//g;
-				if($value > 0){
-
-					my @split = split(/-/,$all_contact[$count]);
-					if (exists $residue_to_helix{$split[0]} && exists $residue_to_helix{$split[1]}){
-						print OUT "$all_contact[$count]\t",$residue_to_helix{$split[0]},"-",$residue_to_helix{$split[1]},"\t$value\n";
-						push @predicted_contact,$all_contact[$count];
-						my $hh = $residue_to_helix{$split[0]}."-".$residue_to_helix{$split[1]};
-						$pred_hh{$hh} = 1;
+
+			## Walk the residue pairs in the same order as the SVM input file,
+			## joining each prediction to its pair as it is read
+			my $helix1 = 1;
+			for (my $h = 0; $h < scalar @topology; $h+=2){
+				for my $p1 ($topology[$h]..$topology[$h+1]){
+					my $helix2 = $helix1 + 1;
+					for (my $nh = $h+2; $nh < scalar @topology; $nh+=2){
+						for my $p2 ($topology[$nh]..$topology[$nh+1]){
+							my $value = <CONTACT>;
+							die "Predictions do not equal number of residue pairs!\n\n" unless defined $value;
+							$value =~ s/\s+//g;
+							if($value > 0){
+								print OUT "$p1-$p2\t$helix1-$helix2\t$value\n";
+								push @predicted_contact,"$p1-$p2" if $keep_contacts;
+								$pred_hh{"$helix1-$helix2"} = 1;
+							}
+						}
+						$helix2++;
 					}
 				}
-				$count++;
+				$helix1++;
 			}
+			die "Predictions do not equal number of residue pairs!\n\n" if defined <CONTACT>;
 			close CONTACT;
 		}
 		close OUT;
@@ -513,18 +509,54 @@ sub main{
 
 	exit unless $graphics;
 
-## Draw layout
+	&draw_layout($output,$graph_out,\%pred_hh,\@predicted_contact);
+
+	# Clean up
+	$system = `rm $input_path/$header* &> /dev/null` if $remove_files;
+}
+
+# Read the helix-helix and residue-residue contacts back from a results file
+sub read_contact_results {
+
+	my $output = shift;
+	my $keep_contacts = $graphics && $draw_rr_contacts;
+	my @predicted_contact = ();
+	my %pred_hh;
 
-	unless (scalar keys %pred_hh){
+	unless(open(OUTPUT,$output)){
+		die "Couldn't open $output\n";
+	}else{
+		while(<OUTPUT>){
+			next if $_ =~ /Topology/;
+			my @split = split(/\s+/,$_);
+			push @predicted_contact,$split[0] if $keep_contacts;
+			$pred_hh{$split[1]} = 1;
+		}
+		close OUTPUT;
+	}
+	return (\%pred_hh,\@predicted_contact);
+}
+
+# Generate the layout with kk_plot and draw each arrangement
+sub draw_layout {
+
+	my ($output,$graph_out,$pred_hh,$predicted_contact) = @_;
+
+	unless (scalar keys %{$pred_hh}){
 		print "\nNo predicted contacts!\n\n";
 		exit;
 	}
 
-	print "Generating layout...\n";
-	my $system = `rm  $graph_out` if -e $graph_out;
+	# In render mode a layout from an earlier run is reused
+	if ($render && -e $graph_out){
+		print "$graph_out exists!\n\n";
+	}else{
+		print "Generating layout...\n";
+		$system = `rm  $graph_out` if -e $graph_out;
 
-	print "$kk_plot $output > $graph_out\n\n";
-	$system = `$kk_plot $output > $graph_out`;
+		print "$kk_plot $output > $graph_out\n\n";
+		$system = `$kk_plot $output > $graph_out`;
+	}
 
 	if (!-e $graph_out){
 		die "Couldn't plot layout!\n\n";
@@ -561,9 +593,9 @@ sub main{
 			       	    		-sequence=>$sequence,
                                     		-helices=>\@topology,
                                     		-ttf_font=>$font,
-				    		-hh_contacts=>\%pred_hh,
+				    		-hh_contacts=>$pred_hh,
 				    		-graph_centres=>\%kk_graph,
-				    		-residue_contacts=>\@predicted_contact,
+				    		-residue_contacts=>$predicted_contact,
 				    		-rotations=>\@rotations,
 				    		-helix_diameter=>235,
 				    		-only_these_helices=>,\@selected_helices
@@ -575,7 +607,7 @@ sub main{
 			       	    		-sequence=>$sequence,
                                     		-helices=>\@topology,
                                     		-ttf_font=>$font,
-				    		-hh_contacts=>\%pred_hh,
+				    		-hh_contacts=>$pred_hh,
 				    		-graph_centres=>\%kk_graph,
 				    		-rotations=>\@rotations,
 				    		-helix_diameter=>235,
@@ -618,9 +650,6 @@ sub main{
 			die "Couldn't create $graph_out!\n";
 		}
 	}
-
-	# Clean up
-	$system = `rm $input_path/$header* &> /dev/null` if $remove_files;
 }
 
 # Create input files for SVM classify
@@ -826,6 +855,9 @@ sub get_arguments{
 					"f=i" => \$erase_previous,
 					"c=i" => \$cores,
 					"r=i" => \$draw_rr_contacts,
+					"cascade=i" => \$cascade,
+					"recall=f" => \$recall,
+					"render=i" => \$render,
 			         	"h"  => sub {&usage;});
 
 		## Get rid of trailing slashes
@@ -932,6 +964,12 @@ sub usage {
 	print "-g <0|1>       Draw schematic. Default 1.\n";
 	print "-r <0|1>       Draw residue-residue contacts. Default 1.\n";
 	print "-c <int>       Number of CPU cores to use for PSI-BLAST. Default 1.\n";
+	print "-cascade <0|1> Reject confident non-contacts with a cheap prefilter model\n";
+	print "               (CONTACT_PREFILTER_DEF*.model, from make prefilter_models) before the\n";
+	print "               full contact model. Default 0.\n";
+	print "-recall <num>  Fraction of full-model contacts the prefilter must keep. Default 0.99.\n";
+	print "-render <0|1>  Only draw the schematic from existing results and _graph.out files\n";
+	print "               (e.g. written by mempack_batch). Default 0.\n";
 	print "-h <0|1>       Show help. Default 0.\n\n";
 	exit;
 }
@@ -958,19 +996,31 @@ sub run_psiblast {
 	$mtx =~ s/\.fasta//;
 	my $out_mtx = $output_path.$mtx;
 
-	my $blast_out = "mempack_tmp.out";
-
 	die "Fasta file $fasta doesn't exist!\n" unless -e $fasta;
 
 	unless (-e $out_mtx || -e $mtx){
 
 		print "Running PSI-BLAST: $fasta\n";
 
-		my $system = `cp -f $fasta mempack_tmp.fasta`;
-		print "$ncbidir/blastpgp -a $cores -j 2 -h 1e-3 -e 1e-3 -b 0 -d $dbname -i mempack_tmp.fasta -C mempack_tmp.chk >& $blast_out\n\n";
-		$system = `$ncbidir/blastpgp -a $cores -j 2 -h 1e-3 -e 1e-3 -b 0 -d $dbname -i mempack_tmp.fasta -C mempack_tmp.chk >& $blast_out`;
+		# blastpgp and makemat write fixed file names (and error.log) into
+		# the current directory, so they run in a private directory that
+		# is removed afterwards and several runs can share a working directory
+		my $tmpdir = tempdir("mempack_XXXXXX", TMPDIR => 1, CLEANUP => 1);
+		my $ncbi = File::Spec->rel2abs($ncbidir);
+		my $db = $dbname;
+		foreach my $ext ('.pal','.pin','.phr','.psq'){
+			if (-e $dbname.$ext){
+				$db = File::Spec->rel2abs($dbname);
+				last;
+			}
+		}
+		my $blast_out = "$tmpdir/mempack_tmp.out";
+
+		my $system = `cp -f $fasta $tmpdir/mempack_tmp.fasta`;
+		print "$ncbi/blastpgp -a $cores -j 2 -h 1e-3 -e 1e-3 -b 0 -d $db -i mempack_tmp.fasta -C mempack_tmp.chk >& $blast_out\n\n";
+		$system = `cd $tmpdir && $ncbi/blastpgp -a $cores -j 2 -h 1e-3 -e 1e-3 -b 0 -d $db -i mempack_tmp.fasta -C mempack_tmp.chk > $blast_out 2>&1`;
 
-		unless (-e "mempack_tmp.chk"){
+		unless (-e "$tmpdir/mempack_tmp.chk"){
 
 			print "There was an error running PSI-BLAST. Did you set the database path correctly?\n\n";
 			open(ERROR,$blast_out);
@@ -983,14 +1033,17 @@ sub run_psiblast {
 			exit;
 		}
 
-		$system = `echo mempack_tmp.chk > mempack_tmp.pn`;
-		$system = `echo mempack_tmp.fasta > mempack_tmp.sn`;
-		$system = `echo "$ncbidir/makemat -P mempack_tmp"`;
-		$system = `$ncbidir/makemat -P mempack_tmp`;
-		$system = `cp mempack_tmp.mtx $mtx`;
-		$system = `rm -f mempack_tmp*`;
-		$system = `rm -f error.log` if -e "error.log";
+		$system = `echo mempack_tmp.chk > $tmpdir/mempack_tmp.pn`;
+		$system = `echo mempack_tmp.fasta > $tmpdir/mempack_tmp.sn`;
+		print "$ncbi/makemat -P mempack_tmp\n";
+		$system = `cd $tmpdir && $ncbi/makemat -P mempack_tmp`;
 
+		# Written under a temporary name first so a concurrent run never
+		# picks up a partial profile
+		if (-e "$tmpdir/mempack_tmp.mtx"){
+			$system = `cp $tmpdir/mempack_tmp.mtx $out_mtx.$$`;
+			rename("$out_mtx.$$",$out_mtx);
+		}
 	}
 
 	if (-e $mtx){
@@ -16,6 +16,8 @@
 // Description: This program uses a force-directed algorithm
 // to predict the helical packing arrangement of transmembrane 
 // proteins based on multiple sequence profiles.
+// This is the layout library, mempack_layout.h; the kk_plot
+// command line is in kk_plot.cpp.
 // 
 
 #include <string>
@@ -25,9 +27,17 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <unordered_set>
+#include <algorithm>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <thread>
+#include <mutex>
 #include <boost/graph/random_layout.hpp>
 #include <boost/graph/circle_layout.hpp>
 #include "kamada_kawai_spring_layout.h"
@@ -37,13 +47,18 @@
 #include <boost/graph/simple_point.hpp>
 #include <boost/graph/connected_components.hpp> 
 #include "globals.h"
+#include "draw_graphs.h"
 #include "paramopt.h"
+#include "work_queue.h"
+#include "rotation_cache.h"
+#include "layout_cache.h"
+#include "kk_layout.h"
+#include "stress_layout.h"
+#include "mempack_layout.h"
 
 using namespace boost;
 using namespace std;
 
-bool verbose = false;
-
 typedef adjacency_list<vecS, vecS, undirectedS, no_property, property<edge_weight_t, double> > Graph;
 typedef graph_traits<Graph>::vertex_descriptor Vertex;
 typedef std::map<std::string, Vertex> NameToVertex;
@@ -79,58 +94,225 @@ static void tokenize(const string str, vector<int>& tokens){
 	
 }
 
-void get_residue_positions(double rotate, int helix, int x){
+double distance_rr(double x1, double y1, double x2, double y2){
+	double d1 = x1 - x2;
+	double d2 = y1 - y2;
+	return(sqrt(d1*d1+d2*d2));
+}
 
-	double helix_x = all_helix_positions[x][helix].first;
-	double helix_y = all_helix_positions[x][helix].second;
-	int seq_start = boundaries[helix*2];
-	int seq_stop = boundaries[(helix*2)+1];
-	double radius = 5.0;
-	double angle = -90.0 + rotate;
+void prepare_rotation_tables(rotation_tables& tables, const xy_array& helix_positions, const vector<int>& boundaries, const vector<pair<int,int> >& contacts, unsigned int residue_count){
+
+	unsigned int total = boundaries.size()/2;
+	tables.boundaries = boundaries;
+	tables.helix_positions = helix_positions;
+	tables.contacts = contacts;
+	tables.helix_of.assign(residue_count, -1);
+	tables.x.assign(total, vector<double>());
+	tables.y.assign(total, vector<double>());
+	tables.helix_contacts.assign(total, vector<unsigned int>());
+	tables.contact_helices.assign(contacts.size(), make_pair(-1,-1));
+
+	for (unsigned int h = 0; h < total; h++){
+		int seq_start = boundaries[h*2];
+		int seq_stop = boundaries[(h*2)+1];
+		int len = seq_stop - seq_start + 1;
+		if (len <= 0) continue;
+
+		// Residues are 100 degrees apart on a helical wheel of radius 5
+		double helix_x = helix_positions.x[h];
+		double helix_y = helix_positions.y[h];
+		double radius = 5.0;
+		tables.x[h].resize(360*len);
+		tables.y[h].resize(360*len);
+		for (int rotate = 0; rotate < 360; rotate++){
+			double angle = -90.0 + rotate;
+			for (int i = 0; i < len; i++){
+				tables.x[h][rotate*len+i] = helix_x + radius * cos (angle * (M_PI/180));
+				tables.y[h][rotate*len+i] = helix_y + radius * sin (angle * (M_PI/180));
+				angle += 100.0;
+			}
+		}
+		// Later helices overwrite earlier ones where boundaries overlap
+		for (int i = seq_start; i <= seq_stop; i++) tables.helix_of[i] = h;
+	}
 
-	for (int i = seq_start; i <= seq_stop; i++){	
-		double aa_x = helix_x + radius * cos (angle * (M_PI/180));
-		double aa_y = helix_y + radius * sin (angle * (M_PI/180));	
-		//cout << i << ":\t" << aa_x << "," << aa_y << endl; 
-		pair <double,double> pos (aa_x,aa_y);
-		all_residue_positions[x][i] = pos;
-		angle += 100.0; 		
-		//cout << i << ":\t" << all_residue_positions[x][i].first << "," << residue_positions[i].second << endl; 		
+	for (unsigned int c = 0; c < contacts.size(); c++){
+		int h1 = tables.helix_of[contacts[c].first];
+		int h2 = tables.helix_of[contacts[c].second];
+		if (h1 >= 0) tables.helix_contacts[h1].push_back(c);
+		if (h2 >= 0 && h2 != h1) tables.helix_contacts[h2].push_back(c);
+		tables.contact_helices[c] = make_pair(h1,h2);
 	}
 }
 
-double distance_rr(double x1, double y1, double x2, double y2){
-	double d1 = x1 - x2;
-	double d2 = y1 - y2;
-	return(sqrt(d1*d1+d2*d2));
+static inline void residue_xy(const rotation_tables& tables, int r, const int* rotations, double& px, double& py){
+
+	int h = tables.helix_of[r];
+	if (h < 0){
+		// Not in a helix of this component, never moved from the origin
+		px = py = 0;
+		return;
+	}
+	int seq_start = tables.boundaries[h*2];
+	int len = tables.boundaries[(h*2)+1] - seq_start + 1;
+	int rotate = rotations[h];
+	if (rotate >= 0 && rotate < 360){
+		px = tables.x[h][rotate*len + r - seq_start];
+		py = tables.y[h][rotate*len + r - seq_start];
+	}else{
+		double angle = -90.0 + rotate;
+		for (int i = seq_start; i < r; i++) angle += 100.0;
+		px = tables.helix_positions.x[h] + 5.0 * cos (angle * (M_PI/180));
+		py = tables.helix_positions.y[h] + 5.0 * sin (angle * (M_PI/180));
+	}
 }
 
-double optimise_rotation(int x){
+// Score rotations given the per-contact distances of the rotations
+// cached_rotations was last scored with. Only contacts touching a
+// helix whose rotation changed are recomputed; dist and
+// cached_rotations are brought up to date. Only the arguments are
+// written to, so schemas can be scored on several threads at once.
+double update_rotation_score(const rotation_tables& tables, const int* rotations, int* cached_rotations, double* dist, bool cached){
+
+	const vector<pair<int,int> >& contacts = tables.contacts;
+	unsigned int total = tables.x.size();
+	unsigned int ncontacts = contacts.size();
+	if (!cached){
+		for (unsigned int c = 0; c < ncontacts; c++){
+			double x1, y1, x2, y2;
+			residue_xy(tables, contacts[c].first, rotations, x1, y1);
+			residue_xy(tables, contacts[c].second, rotations, x2, y2);
+			dist[c] = distance_rr(x1, y1, x2, y2);
+		}
+		for (unsigned int h = 0; h < total; h++) cached_rotations[h] = rotations[h];
+	}else{
+		for (unsigned int h = 0; h < total; h++){
+			if (rotations[h] == cached_rotations[h]) continue;
+			const vector<unsigned int>& touching = tables.helix_contacts[h];
+			for (unsigned int k = 0; k < touching.size(); k++){
+				unsigned int c = touching[k];
+
+				// A contact between two changed helices is done once,
+				// with the lower numbered one
+				int other = tables.contact_helices[c].first == (int)h ? tables.contact_helices[c].second : tables.contact_helices[c].first;
+				if (other >= 0 && other < (int)h && rotations[other] != cached_rotations[other]) continue;
+				double x1, y1, x2, y2;
+				residue_xy(tables, contacts[c].first, rotations, x1, y1);
+				residue_xy(tables, contacts[c].second, rotations, x2, y2);
+				dist[c] = distance_rr(x1, y1, x2, y2);
+			}
+		}
+		for (unsigned int h = 0; h < total; h++) cached_rotations[h] = rotations[h];
+	}
 
+	// Summed in contact order
 	double total_distance = 0;
+	for (unsigned int c = 0; c < ncontacts; c++) total_distance += dist[c];
+	return(total_distance);
+}
+
+// Position of residue r in every lane, rot holding ROTATION_LANES
+// angles per helix
+static inline void gather_lanes(const rotation_tables& tables, int r, const int* rot, const int* const* rotations, int lanes, double* px, double* py){
 
-	for (unsigned int i = 0; i < total; i++){
-		//cout << "Rotating helix " << i+1 << " by " << all_rotations[x][i] << " degrees..." << endl;	
-		get_residue_positions(all_rotations[x][i], i, x);
+	int h = tables.helix_of[r];
+	if (h < 0){
+		for (int k = 0; k < ROTATION_LANES; k++) px[k] = py[k] = 0;
+		return;
 	}
+	int seq_start = tables.boundaries[h*2];
+	int len = tables.boundaries[(h*2)+1] - seq_start + 1;
+	const int* angle = rot + h*ROTATION_LANES;
+	const double* tx = &tables.x[h][r - seq_start];
+	const double* ty = &tables.y[h][r - seq_start];
+	for (int k = 0; k < ROTATION_LANES; k++){
+		int rotate = angle[k];
+		if (rotate >= 0 && rotate < 360){
+			px[k] = tx[rotate*len];
+			py[k] = ty[rotate*len];
+		}else{
+			residue_xy(tables, r, rotations[k < lanes ? k : 0], px[k], py[k]);
+		}
+	}
+}
 
-    	for(rr_hh_map::const_iterator it = residues_to_helices.begin(); it != residues_to_helices.end(); ++it){
-        	/*
-		cout << "Residues: " << it->first.first << "-" << it->first.second << endl;
-		cout << "r1 x: " << residue_positions[it->first.first].first << endl;
-		cout << "r1 y: " << residue_positions[it->first.first].second << endl;
-		cout << "r2 x: " << residue_positions[it->first.second].first << endl;
-		cout << "r2 y: " << residue_positions[it->first.second].second << endl;
-		*/
+// Score up to ROTATION_LANES sets of rotations at once. The rotations
+// are transposed so that each helix holds one angle per lane, residue
+// positions for all lanes are gathered from the tables and the
+// distances of a contact are computed across the lanes in SIMD
+// registers. Each lane is summed in contact order, so the scores are
+// exactly those of update_rotation_score. The per-contact distances
+// of lane k are written to dist[k] for later incremental updates.
+void batch_rotation_scores(const rotation_tables& tables, const int* const* rotations, double* const* dist, int lanes, double* scores){
+
+	const vector<pair<int,int> >& contacts = tables.contacts;
+	unsigned int total = tables.x.size();
+	vector<int> rot(total*ROTATION_LANES);
+	double x1[ROTATION_LANES] __attribute__((aligned(16)));
+	double y1[ROTATION_LANES] __attribute__((aligned(16)));
+	double x2[ROTATION_LANES] __attribute__((aligned(16)));
+	double y2[ROTATION_LANES] __attribute__((aligned(16)));
+	double d[ROTATION_LANES] __attribute__((aligned(16)));
+	double sum[ROTATION_LANES];
+
+	// Unused lanes repeat lane 0 and are never stored
+	for (unsigned int h = 0; h < total; h++){
+		for (int k = 0; k < ROTATION_LANES; k++) rot[h*ROTATION_LANES+k] = rotations[k < lanes ? k : 0][h];
+	}
+	for (int k = 0; k < ROTATION_LANES; k++) sum[k] = 0;
+
+	unsigned int ncontacts = contacts.size();
+	for (unsigned int c = 0; c < ncontacts; c++){
+		gather_lanes(tables, contacts[c].first, &rot[0], rotations, lanes, x1, y1);
+		gather_lanes(tables, contacts[c].second, &rot[0], rotations, lanes, x2, y2);
+#ifdef __SSE2__
+		for (int k = 0; k < ROTATION_LANES; k += 2){
+			__m128d dx = _mm_sub_pd(_mm_load_pd(x1+k), _mm_load_pd(x2+k));
+			__m128d dy = _mm_sub_pd(_mm_load_pd(y1+k), _mm_load_pd(y2+k));
+			_mm_store_pd(d+k, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx,dx), _mm_mul_pd(dy,dy))));
+		}
+#else
+		for (int k = 0; k < ROTATION_LANES; k++) d[k] = distance_rr(x1[k], y1[k], x2[k], y2[k]);
+#endif
+		for (int k = 0; k < lanes; k++){
+			dist[k][c] = d[k];
+			sum[k] += d[k];
+		}
+	}
+	for (int k = 0; k < lanes; k++) scores[k] = sum[k];
+}
 
-		double this_distance = distance_rr(all_residue_positions[x][it->first.first].first,all_residue_positions[x][it->first.first].second,all_residue_positions[x][it->first.second].first,all_residue_positions[x][it->first.second].second);
+// Helix of the arrangement that residue r belongs to, -1 if none
+int residue_helix(const rotation_tables& tables, int r){
 
-		total_distance += this_distance;
+	return(tables.helix_of[r]);
+}
 
-    	}	
+// Distance of contact c with the helices at the given rotations
+double contact_distance(const rotation_tables& tables, unsigned int c, const int* rotations){
 
-	return(total_distance);
+	double x1, y1, x2, y2;
+	residue_xy(tables, tables.contacts[c].first, rotations, x1, y1);
+	residue_xy(tables, tables.contacts[c].second, rotations, x2, y2);
+	return(distance_rr(x1, y1, x2, y2));
+}
 
+// Distance summed over the contacts that touch helix h, with helix h
+// at rotation rotate and every other helix as given in rotations
+double helix_contact_distance(const rotation_tables& tables, int h, int* rotations, int rotate){
+
+	int saved = rotations[h];
+	rotations[h] = rotate;
+	double sum = 0;
+	const vector<unsigned int>& touching = tables.helix_contacts[h];
+	for (unsigned int k = 0; k < touching.size(); k++){
+		double x1, y1, x2, y2;
+		residue_xy(tables, tables.contacts[touching[k]].first, rotations, x1, y1);
+		residue_xy(tables, tables.contacts[touching[k]].second, rotations, x2, y2);
+		sum += distance_rr(x1, y1, x2, y2);
+	}
+	rotations[h] = saved;
+	return(sum);
 }
 
 bool lineSegmentIntersection(double Ax, double Ay,double Bx, double By,double Cx, double Cy,double Dx, double Dy) {
@@ -180,79 +362,213 @@ bool lineSegmentIntersection(double Ax, double Ay,double Bx, double By,double Cx
 	return true;
 }
 
-int count_crossovers(unsigned int total, int x){
+// Loop k joins helix k to helix k+1. Loops with even k are on one side
+// of the membrane and loops with odd k on the other, and only loops on
+// the same side can cross.
+static inline bool loops_cross(const xy_array& p, unsigned int a, unsigned int b){
+
+	if (a > b) swap(a, b);
+	return(lineSegmentIntersection(p.x[a],p.y[a],p.x[a+1],p.y[a+1],p.x[b],p.y[b],p.x[b+1],p.y[b+1]));
+}
+
+// Sides with more loops than this are counted by a sweep
+#define SWEEP_LOOPS 32
+
+// Crossings between the loops of one side by a sweep along x: loops are
+// taken in order of their left end and only tested against earlier
+// loops that reach that far, since loops whose x ranges don't overlap
+// can't cross.
+static int sweep_crossovers(const xy_array& p, unsigned int total, unsigned int side){
+
+	vector<pair<double,unsigned int> > order;
+	vector<unsigned int> active;
+	for (unsigned int k = side; k+1 < total; k += 2) order.push_back(make_pair(min(p.x[k], p.x[k+1]), k));
+	sort(order.begin(), order.end());
+
+	int cross_overs = 0;
+	for (unsigned int i = 0; i < order.size(); i++){
+		double left = order[i].first;
+		unsigned int k = order[i].second;
+		unsigned int kept = 0;
+		for (unsigned int a = 0; a < active.size(); a++){
+			unsigned int l = active[a];
+			if (max(p.x[l], p.x[l+1]) < left) continue;
+			active[kept++] = l;
+			if (loops_cross(p, l, k)) cross_overs++;
+		}
+		active.resize(kept);
+		active.push_back(k);
+	}
+	return(cross_overs);
+}
+
+// Total loop crossovers of arrangement x
+static int count_crossovers(const layout_context& ctx, int x){
 
-	vector<vector<double> > lines;
+	unsigned int total = ctx.total;
+	bool verbose = ctx.verbose;
+	const xy_array& p = ctx.all_helix_positions[x];
 	int cross_overs = 0;
 
-	//cout << "First side..." << endl;
-	for (unsigned int i= 0; i < total; i+=2){	
-		if ((i+1) < total){
-			if(verbose) cout << "Loop between helix " << i+1 << " and " << i+2 << endl;	
-			if(verbose) cout << all_helix_positions[x][i].first << "," << all_helix_positions[x][i].second << endl;
-			if(verbose) cout << all_helix_positions[x][i+1].first << "," << all_helix_positions[x][i+1].second << endl;
-			vector<double> line;
-			line.push_back(all_helix_positions[x][i].first);
-			line.push_back(all_helix_positions[x][i].second);
-			line.push_back(all_helix_positions[x][i+1].first);
-			line.push_back(all_helix_positions[x][i+1].second);
-			lines.push_back(line);
-		}
-	}
-	//cout << endl;
-	for (unsigned int i= 0; i < lines.size(); i++){
-		for (unsigned int j= i+1; j < lines.size(); j++){
-			if(verbose) cout << "Line " << i+1 << "\t" << lines[i][0] << "," << lines[i][1]  << " - "<< lines[i][2] << "," << lines[i][3] << endl;
-			if(verbose) cout << "Line " << j+1 << "\t" << lines[j][0] << "," << lines[j][1]  << " - "<< lines[j][2] << "," << lines[j][3] << endl;			
-			if (lineSegmentIntersection(lines[i][0],lines[i][1],lines[i][2],lines[i][3],lines[j][0],lines[j][1],lines[j][2],lines[j][3])){
-				if(verbose) cout << "Lines intersect." << endl;
-				cross_overs++;			
-			}else{
-				if(verbose) cout << "Lines do not intersect!" << endl;
-			}			
+	for (unsigned int side = 0; side < 2; side++){
+		if (!verbose && total/2 > SWEEP_LOOPS){
+			cross_overs += sweep_crossovers(p, total, side);
+			continue;
 		}
+		for (unsigned int a = side; a+1 < total; a += 2){
+			if(verbose) cout << "Loop between helix " << a+1 << " and " << a+2 << endl;	
+			if(verbose) cout << p.x[a] << "," << p.y[a] << endl;
+			if(verbose) cout << p.x[a+1] << "," << p.y[a+1] << endl;
+		}
+		for (unsigned int a = side; a+1 < total; a += 2){
+			for (unsigned int b = a+2; b+1 < total; b += 2){
+				if (loops_cross(p, a, b)){
+					if(verbose) cout << "Loops " << a+1 << "-" << a+2 << " and " << b+1 << "-" << b+2 << " intersect." << endl;
+					cross_overs++;			
+				}
+			}
+		}
+	}
+	return(cross_overs);
+}
+
+// Crossings that involve a loop touching helix h or helix j, each
+// counted once. Swapping h and j only moves these loops, so the total
+// after the swap is the total before plus the change in this count.
+static int swap_crossovers(unsigned int total, const xy_array& p, int h, int j){
+
+	int moved[4] = { h-1, h, j-1, j };
+	int cross_overs = 0;
+	for (int m = 0; m < 4; m++){
+		int a = moved[m];
+		if (a < 0 || a+1 >= (int)total) continue;
+
+		// j-1 can be h
+		bool repeat = false;
+		for (int n = 0; n < m; n++) if (moved[n] == a) repeat = true;
+		if (repeat) continue;
+
+		for (int b = a % 2; b+1 < (int)total; b += 2){
+			if (b == a) continue;
 
+			// A crossing between two moved loops is counted with the first
+			bool earlier = false;
+			for (int n = 0; n < m; n++) if (moved[n] == b) earlier = true;
+			if (earlier) continue;
+
+			if (loops_cross(p, a, b)) cross_overs++;
+		}
 	}
-	lines.clear();
-	//cout << endl;
+	return(cross_overs);
+}
 
-	//cout << "Second side..." << endl;
-	for (unsigned int i= 1; i < total; i+=2){
-		if ((i+1) < total){
-			if(verbose) cout << "Loop between helix " << i+1 << " and " << i+2 << endl;	
-			if(verbose) cout << all_helix_positions[x][i].first << "," << all_helix_positions[x][i].second << endl;
-			if(verbose) cout << all_helix_positions[x][i+1].first << "," << all_helix_positions[x][i+1].second << endl;
-			vector<double> line;
-			line.push_back(all_helix_positions[x][i].first);
-			line.push_back(all_helix_positions[x][i].second);
-			line.push_back(all_helix_positions[x][i+1].first);
-			line.push_back(all_helix_positions[x][i+1].second);
-			lines.push_back(line);
-		}	
+// Positions within this fraction of the size of the layout are the same
+#define SYMMETRY_TOLERANCE 1e-6
+
+// Number of position (x,y) among the sorted positions, -1 if none
+static int position_number(const vector<pair<double,double> >& positions, double x, double y, double tolerance){
+
+	vector<pair<double,double> >::const_iterator it = lower_bound(positions.begin(), positions.end(), make_pair(x - tolerance, y - tolerance));
+	for (; it != positions.end() && it->first <= x + tolerance; it++){
+		if (fabs(it->second - y) <= tolerance) return(it - positions.begin());
 	}
-	//cout << endl;
-	for (unsigned int i= 0; i < lines.size(); i++){
-		for (unsigned int j= i+1; j < lines.size(); j++){
-			//cout << "Line " << i+1 << "\t" << lines[i][0] << "," << lines[i][1]  << " - "<< lines[i][2] << "," << lines[i][3] << endl;
-			//cout << "Line " << j+1 << "\t" << lines[j][0] << "," << lines[j][1]  << " - "<< lines[j][2] << "," << lines[j][3] << endl;			
-			if (lineSegmentIntersection(lines[i][0],lines[i][1],lines[i][2],lines[i][3],lines[j][0],lines[j][1],lines[j][2],lines[j][3])){
-				if(verbose) cout << "Lines intersect." << endl;
-				cross_overs++;			
-			}else{
-				if(verbose) cout << "Lines do not intersect!" << endl;
-			}			
+	return(-1);
+}
+
+// Starts the arrangements of a layout: its distinct positions in sorted
+// order, and the rotations and mirror images about its centroid that
+// take them onto each other. A point farthest from the centroid has to
+// go to a point just as far, which gives every candidate.
+static void start_arrangements(arrangement_set& arrangements, const xy_array& layout){
+
+	vector<pair<double,double> >& positions = arrangements.positions;
+	positions.clear();
+	for (unsigned int h = 0; h < layout.x.size(); h++) positions.push_back(make_pair(layout.x[h], layout.y[h]));
+	sort(positions.begin(), positions.end());
+	positions.erase(unique(positions.begin(), positions.end()), positions.end());
+
+	unsigned int n = positions.size();
+	double cx = 0, cy = 0;
+	for (unsigned int p = 0; p < n; p++){
+		cx += positions[p].first/n;
+		cy += positions[p].second/n;
+	}
+	vector<double> radius(n), angle(n);
+	unsigned int far = 0;
+	for (unsigned int p = 0; p < n; p++){
+		radius[p] = distance_rr(positions[p].first, positions[p].second, cx, cy);
+		angle[p] = atan2(positions[p].second - cy, positions[p].first - cx);
+		if (radius[p] > radius[far]) far = p;
+	}
+	double tolerance = SYMMETRY_TOLERANCE * max(radius[far], 1.0);
+
+	set<vector<int> > symmetries;
+	vector<int> identity(n);
+	for (unsigned int p = 0; p < n; p++) identity[p] = p;
+	symmetries.insert(identity);
+	for (unsigned int q = 0; q < n; q++){
+		if (fabs(radius[q] - radius[far]) > tolerance) continue;
+		for (int mirror = 0; mirror < 2; mirror++){
+			vector<int> image(n);
+			bool onto = true;
+			for (unsigned int p = 0; p < n && onto; p++){
+				double a = mirror ? angle[far] + angle[q] - angle[p] : angle[p] + angle[q] - angle[far];
+				image[p] = position_number(positions, cx + radius[p]*cos(a), cy + radius[p]*sin(a), tolerance);
+				onto = image[p] >= 0;
+			}
+			if (onto) symmetries.insert(image);
 		}
+	}
+	arrangements.symmetries.assign(symmetries.begin(), symmetries.end());
+	arrangements.seen.clear();
+}
+
+// Hash of arrangement x, the same for every arrangement that is a
+// rotation or mirror image of it
+static unsigned long long arrangement_hash(const layout_context& ctx, int x){
+
+	const arrangement_set& arrangements = ctx.arrangements_seen;
+	const xy_array& p = ctx.all_helix_positions[x];
+	unsigned int total = ctx.total;
+	vector<int> number(total);
+	for (unsigned int h = 0; h < total; h++) number[h] = position_number(arrangements.positions, p.x[h], p.y[h], 0);
 
+	vector<int> smallest, image(total);
+	for (unsigned int s = 0; s < arrangements.symmetries.size(); s++){
+		for (unsigned int h = 0; h < total; h++) image[h] = arrangements.symmetries[s][number[h]];
+		if (smallest.empty() || image < smallest) smallest = image;
 	}
-	lines.clear();
-	//cout << endl;
-	
-	return(cross_overs);
 
+	// 64 bit FNV-1a over the position numbers
+	unsigned long long hash = 14695981039346656037ULL;
+	for (unsigned int h = 0; h < total; h++){
+		for (int b = 0; b < 4; b++){
+			hash ^= (smallest[h] >> 8*b) & 0xff;
+			hash *= 1099511628211ULL;
+		}
+	}
+	return(hash);
+}
 
+// Drop arrangements that ended up the same as an earlier one, which can
+// happen when a swap with fewer crossovers is made in place
+static void remove_duplicate_arrangements(layout_context& ctx){
+
+	std::unordered_set<unsigned long long> kept;
+	vector<xy_array> unique;
+	for (unsigned int x = 0; x < ctx.all_helix_positions.size(); x++){
+		if (kept.insert(arrangement_hash(ctx, x)).second) unique.push_back(ctx.all_helix_positions[x]);
+	}
+	ctx.all_helix_positions.swap(unique);
 }
 
-void swap_helices(int total, vector<int>& h1, vector<int>& h2, int x){	
+static void swap_helices(layout_context& ctx, vector<int>& h1, vector<int>& h2, int x){	
+
+	int total = ctx.total;
+	bool verbose = ctx.verbose;
+
+	// Kept up to date as swaps are made in place
+	int cross_overs = count_crossovers(ctx,x);
 
 	// Loop through first helix
 	for (int h = 0; h < total; h++){
@@ -276,20 +592,14 @@ void swap_helices(int total, vector<int>& h1, vector<int>& h2, int x){
 			if (h1_contact.size() == h2_contact.size() && h1_contact.size()){
 
 				// Make sure we skip these two helices when we recurse
-				string seen("");
-				stringstream n,m;
-				n << h+1;
-				seen.append(n.str());
-				seen.append("-");
-				m << j+1;
-				seen.append(m.str());
+				unsigned int seen = h*total + j;
 				
 				int required_score = h1_contact.size();
 				int correct = 0;
 				int seen_j = 0;
 				int seen_h = 0;
 				
-				if(!helix_swaps_seen[seen]){
+				if(!ctx.helix_swaps_seen[seen]){
 				
 					for (unsigned int k = 0; k < h1_contact.size(); k++){
 						for (unsigned int l = 0; l < h2_contact.size(); l++){
@@ -319,8 +629,8 @@ void swap_helices(int total, vector<int>& h1, vector<int>& h2, int x){
 				if (correct == required_score){
 			
 					// Make sure we skip these two helices when we recurse
-					helix_swaps_seen[seen] = 1;
-					map<const string,int> helix_swaps_seen_copy = helix_swaps_seen;
+					ctx.helix_swaps_seen[seen] = true;
+					vector<bool> helix_swaps_seen_copy = ctx.helix_swaps_seen;
 		
 					// These helices have intechangable positions
 					// Work out same-side loop crossover scores					
@@ -338,19 +648,15 @@ void swap_helices(int total, vector<int>& h1, vector<int>& h2, int x){
 					}
 					if(verbose) cout << endl;						
 					
-					int cross_overs = count_crossovers(total,x);
 					if(verbose) cout << "Number of loop crossovers in current helix positions:\t" << cross_overs << endl;
-					
-					pair<double,double> swap_h1,swap_h2;
-					swap_h1 = make_pair(all_helix_positions[x][h].first,all_helix_positions[x][h].second);
-					swap_h2 = make_pair(all_helix_positions[x][j].first,all_helix_positions[x][j].second);
+					int moved_before = swap_crossovers(total, ctx.all_helix_positions[x], h, j);
 					
 					if(verbose) cout << "Swapping positions of helices " << h+1 << " and " << j+1 << endl;
 					
-					all_helix_positions[x][h] = swap_h2;
-					all_helix_positions[x][j] = swap_h1;
+					swap(ctx.all_helix_positions[x].x[h], ctx.all_helix_positions[x].x[j]);
+					swap(ctx.all_helix_positions[x].y[h], ctx.all_helix_positions[x].y[j]);
 					
-					int cross_overs_swapped = count_crossovers(total,x);
+					int cross_overs_swapped = cross_overs - moved_before + swap_crossovers(total, ctx.all_helix_positions[x], h, j);
 					
 					if(verbose) cout << "Number of loop crossovers in new helix positions:\t" << cross_overs_swapped << endl;
 					
@@ -358,23 +664,44 @@ void swap_helices(int total, vector<int>& h1, vector<int>& h2, int x){
 						if(verbose) cout << "Swapped conformation has more crossovers, reverting to original helix positions." << endl;
 						if(verbose) cout << "Swapping positions of helices " << j+1 << " and " << h+1 << endl;
 						// Swap back
-						all_helix_positions[x][h] = swap_h1;
-						all_helix_positions[x][j] = swap_h2;
+						swap(ctx.all_helix_positions[x].x[h], ctx.all_helix_positions[x].x[j]);
+						swap(ctx.all_helix_positions[x].y[h], ctx.all_helix_positions[x].y[j]);
 					
 					}else if(cross_overs == cross_overs_swapped){
 						if(verbose) cout << "Crossovers are equal; helices " << h+1 << " and " << j+1 << " are interchangable." << endl;
-						all_helix_positions.push_back(all_helix_positions[x]);
+
+						// The same arrangement is often reached by swapping
+						// in a different order; it is only kept, and its own
+						// swaps only explored, the first time
+						bool new_arrangement = ctx.arrangements_seen.seen.insert(arrangement_hash(ctx, x)).second;
+						if (new_arrangement) ctx.all_helix_positions.push_back(ctx.all_helix_positions[x]);
 						// Swap back
-						all_helix_positions[x][h] = swap_h1;
-						all_helix_positions[x][j] = swap_h2;
+						swap(ctx.all_helix_positions[x].x[h], ctx.all_helix_positions[x].x[j]);
+						swap(ctx.all_helix_positions[x].y[h], ctx.all_helix_positions[x].y[j]);
 						
-						// Recurse
-						if(verbose) cout << "Recursing..." << endl;
-						swap_helices(total,h1,h2,x+1);
-						if(verbose) cout << "Finished recursing..." << endl;						
-						helix_swaps_seen = helix_swaps_seen_copy;
+						if (new_arrangement){
+							// Recurse
+							if(verbose) cout << "Recursing..." << endl;
+							swap_helices(ctx,h1,h2,ctx.all_helix_positions.size()-1);
+							if(verbose) cout << "Finished recursing..." << endl;						
+						}else{
+							if(verbose) cout << "Arrangement already seen." << endl;
+						}
+						ctx.helix_swaps_seen = helix_swaps_seen_copy;
 					}else{
 						if(verbose) cout << "Swapped conformation has fewer crossovers, using new helix positions." << endl;
+						cross_overs = cross_overs_swapped;
+
+						// Arrangement x is now another one; the one it was
+						// is no longer in the list, so it is forgotten and
+						// can be reached again by another path
+						unsigned long long changed = arrangement_hash(ctx, x);
+						swap(ctx.all_helix_positions[x].x[h], ctx.all_helix_positions[x].x[j]);
+						swap(ctx.all_helix_positions[x].y[h], ctx.all_helix_positions[x].y[j]);
+						ctx.arrangements_seen.seen.erase(arrangement_hash(ctx, x));
+						swap(ctx.all_helix_positions[x].x[h], ctx.all_helix_positions[x].x[j]);
+						swap(ctx.all_helix_positions[x].y[h], ctx.all_helix_positions[x].y[j]);
+						ctx.arrangements_seen.seen.insert(changed);
 					}								
 				}		
 			}			
@@ -384,79 +711,232 @@ void swap_helices(int total, vector<int>& h1, vector<int>& h2, int x){
 	}
 }
 
-int main(int argc, char* argv[]){
+// Every edge of the helix contact graph is this long
+#define EDGE_WEIGHT 1.2
 
-  	double width = 2000;
-  	double height = 2000;	
+// layout_tolerance of the Boost layout, that also gives up after
+// max_iterations moves and counts the moves made
+struct layout_budget {
 
-       // Exit unless filename given as argument
-        if (argc < 2){
-                cout << "File containing graph data is required." << endl;
-		exit(1);
-        }
-	
-       	ifstream is(argv[1]);
+	layout_budget(int max_iterations, int* iterations) : max_iterations(max_iterations), iterations(iterations) { *iterations = 0; }
 
-        // Check to make sure the stream is ok
-        if(!is.good()){
-                cout << "Cannot open file "<< argv[1] << endl;
-                exit(1);
+	bool operator()(double delta_p, Vertex p, const Graph& g, bool global){
+		bool done = tolerance(delta_p, p, g, global);
+		if (!global || done) return done;
+		if (*iterations >= max_iterations) return true;
+		(*iterations)++;
+		return false;
+	}
+
+	layout_tolerance<double> tolerance;
+	int max_iterations;
+	int* iterations;
+};
+
+static vector<pair<int,int> > graph_edges(const Graph& G){
+
+	vector<pair<int,int> > e;
+	graph_traits<Graph>::edge_iterator ei, ei_end;
+	for (tie(ei, ei_end) = boost::edges(G); ei != ei_end; ++ei){
+		e.push_back(make_pair(source(*ei, G), target(*ei, G)));
+	}
+	return(e);
+}
+
+// Spring energy of the layout in position_vec, false if G isn't connected
+static bool layout_energy(const vector<pair<int,int> >& e, double edge_width, const PositionVec& position_vec, double& energy){
+
+	vector<double> x(position_vec.size()), y(position_vec.size());
+	for (unsigned int v = 0; v < x.size(); v++){
+		x[v] = position_vec[v].x;
+		y[v] = position_vec[v].y;
+	}
+	return(kamada_kawai_energy(x.size(), e, EDGE_WEIGHT, edge_width, &x[0], &y[0], energy));
+}
+
+// Lay out G from position_vec, returns the iterations made
+static int run_layout(const Graph& G, int layout, int max_iterations, double tolerance, double edge_width, PositionVec& position_vec){
+
+	int iterations = 0;
+	if (layout == LAYOUT_FAST || layout == LAYOUT_SMACOF){
+		vector<double> x(position_vec.size()), y(position_vec.size());
+		for (unsigned int v = 0; v < x.size(); v++){
+			x[v] = position_vec[v].x;
+			y[v] = position_vec[v].y;
+		}
+		if (layout == LAYOUT_SMACOF){
+			double energy;
+			stress_majorisation_layout(x.size(), graph_edges(G), EDGE_WEIGHT, edge_width, &x[0], &y[0], tolerance, max_iterations, iterations, energy);
+		}else{
+			uniform_kamada_kawai_layout(x.size(), graph_edges(G), EDGE_WEIGHT, edge_width, &x[0], &y[0], max_iterations, iterations);
+		}
+		for (unsigned int v = 0; v < x.size(); v++){
+			position_vec[v].x = x[v];
+			position_vec[v].y = y[v];
+		}
 	}else{
-		cout << "Reading input file " << argv[1] << "..." << endl;
+		PositionMap position(position_vec.begin(), get(vertex_index, G));
+		kamada_kawai_spring_layout(G, position, get(edge_weight, G), edge_length(edge_width), layout_budget(max_iterations, &iterations));
+	}
+	return(iterations);
+}
+
+// Lays out G from position_vec and from starts-1 random positions in
+// the width by height box at the same time, and keeps the layout with
+// the lowest spring energy. Start s draws its positions from its own
+// stream, seed + s*2^32, clear of the streams of the arrangements.
+// The starts share out threads threads.
+static void multi_start_layout(const Graph& G, int layout, unsigned int starts, int threads, int max_iterations, double tolerance, unsigned long long seed, double width, double height, double edge_width, PositionVec& position_vec, ostream& log){
+
+	vector<PositionVec> start_positions(starts, position_vec);
+	for (unsigned int s = 1; s < starts; s++){
+		Rng rng;
+		rng_seed(&rng, seed + ((unsigned long long)s << 32));
+		for (unsigned int v = 0; v < position_vec.size(); v++){
+			start_positions[s][v].x = uni64(&rng) * width;
+			start_positions[s][v].y = uni64(&rng) * height;
+		}
+	}
+
+	vector<pair<int,int> > e = graph_edges(G);
+	vector<int> iterations(starts, 0), connected(starts, 0);
+	vector<double> energy(starts, 0.0);
+	{
+		work_queue pool(min(starts, (unsigned int)threads));
+		for (unsigned int s = 0; s < starts; s++){
+			pool.push([&, s](){
+				iterations[s] = run_layout(G, layout, max_iterations, tolerance, edge_width, start_positions[s]);
+				connected[s] = layout_energy(e, edge_width, start_positions[s], energy[s]);
+			});
+		}
+		pool.wait();
 	}
 
+	// A graph that isn't connected isn't laid out at all
+	if (!connected[0]) return;
+
+	unsigned int best = 0;
+	for (unsigned int s = 0; s < starts; s++){
+		log << "Layout start " << s+1 << ": energy " << energy[s] << " after " << iterations[s] << " iterations";
+		if (iterations[s] >= max_iterations) log << ", stopped at the iteration limit";
+		log << endl;
+		if (energy[s] < energy[best]) best = s;
+	}
+	log << "Using layout start " << best+1 << "." << endl << endl;
+	copy(start_positions[best].begin(), start_positions[best].end(), position_vec.begin());
+}
+
+
+layout_options::layout_options() : engine(LAYOUT_FAST), starts(1), iterations(KK_MAX_ITERATIONS), tolerance(0.0001),
+	optimiser(OPTIMISER_GA), cd_restarts(10), dp_bins(36), dp_max_width(3), ga_eval(GA_EVAL_INCREMENTAL),
+	threads(thread::hardware_concurrency()), seed(random_seed()), warm_start(false), top(0), verbose(false){
+
+	GAParams defaults = {50, 0.1, 0.8, 1.0, 50, 0.0, 0, 0.0, 0, 0, 0};
+	ga = defaults;
+}
+
+bool read_layout_input(istream& is, vector<int>& boundaries, vector<layout_contact>& contacts){
+
+	if (!is.good()) return false;
+
         string line,topology_string;
-        char ch[150],topology[150];
-	int a,b,c,d, edges = 0;
-	vector<int> h1, h2;
-	
-        // Get line from stream
-        while(getline(is,line)){
+	layout_contact contact;
 
-                // copy the string to a character array
-                strcpy(ch, line.c_str());
-			
-                if(sscanf(ch, "%d%*c%d %d%*c%d %*f", &a,&b,&c,&d) == 4){
-			//cout << "Residues:\t" << a << " ---> " << b << " Helices:\t" << c << " ---> " << d << endl;			
-			
-			const pair <int,int> rr (a,b);
-			const pair <int,int> hh (c,d);
+        // Get line from stream, lines are parsed where they are so any
+        // length will do
+        while(getline(is,line)){
 
-			residues_to_helices.insert(pair<const pair<int,int>, const pair<int,int> >(rr,hh));			
-			
-			int tag = 0;
-			for (unsigned int i = 0; i < h1.size(); i++){
-				if (h1[i] == c-1 && h2[i] == d-1){
-					tag++;
-				}
-			}			
-			if(!tag){
-				h1.push_back(c-1);
-				h2.push_back(d-1);
-				edges++;
-			}
-		
-                }else if (sscanf(ch, "# Topology: %s", topology) == 1){
-			topology_string = topology;
-			tokenize(topology_string, boundaries);
-                       	//cout << "Topology:\t" << topology << endl << endl;
+		int topology_start = -1;
+                if(sscanf(line.c_str(), "%d%*c%d %d%*c%d %*f", &contact.residue1, &contact.residue2, &contact.helix1, &contact.helix2) == 4){
+			contacts.push_back(contact);
+                }else if (sscanf(line.c_str(), "# Topology: %n", &topology_start) == 0 && topology_start >= 0){
+			istringstream topology(line.substr(topology_start));
+			if (topology >> topology_string) tokenize(topology_string, boundaries);
 		} 
         }
-	is.close();
+	return true;
+}
+
+bool mempack_layout(const vector<int>& helix_boundaries, const vector<layout_contact>& helix_contacts, const layout_options& options,
+                    layout_result& result, ostream& log, string& error){
+
+	// The working state of this call, so calls can run at once
+	layout_context ctx;
+
+  	double width = 2000;
+  	double height = 2000;	
+
+	optimiser_settings settings;
+	settings.optimiser = options.optimiser;
+	settings.cd_restarts = options.cd_restarts;
+	settings.dp_bins = options.dp_bins;
+	settings.dp_max_width = options.dp_max_width;
+	settings.ga_eval = options.ga_eval;
+	settings.ga = options.ga;
+	ctx.threads = max(options.threads, 1);
+	ctx.verbose = options.verbose;
+	unsigned long long seed = options.seed;
+	const string& cache_file = options.rotation_cache;
+
+	result.components.clear();
+	ctx.boundaries = helix_boundaries;
+
+	int edges = 0;
+	vector<int> h1, h2;
+
+	// Helix pairs seen so far, first helix in the high 32 bits
+	std::unordered_set<unsigned long long> helix_pairs;
+	for (unsigned int k = 0; k < helix_contacts.size(); k++){
+		const layout_contact& c = helix_contacts[k];
+		ctx.contacts.push_back(make_pair(c.residue1, c.residue2));
+		unsigned long long helix_pair = ((unsigned long long)(unsigned int)(c.helix1-1) << 32) | (unsigned int)(c.helix2-1);
+		if(helix_pairs.insert(helix_pair).second){
+			h1.push_back(c.helix1-1);
+			h2.push_back(c.helix2-1);
+			edges++;
+		}
+	}
+
+	// Each residue pair counts once, in residue order
+	sort(ctx.contacts.begin(), ctx.contacts.end());
+	ctx.contacts.erase(unique(ctx.contacts.begin(), ctx.contacts.end()), ctx.contacts.end());
 
 	if(!edges){
-		cout << "No contacts predicted!" << endl;
-		exit(1);
+		error = "No contacts predicted!";
+		return false;
 	}
-	if(boundaries.size() % 2){
-		cout << "Uneven number of helix boundaries!" << endl;
-		exit(1);
+	if(ctx.boundaries.size() % 2){
+		error = "Uneven number of helix boundaries!";
+		return false;
 	}else{
-		total = boundaries.size()/2;
+		ctx.total = ctx.boundaries.size()/2;
+	}
+	if(!ctx.total){
+		error = "No helices found!";
+		return false;
+	}
+	for (int k = 0; k < edges; k++){
+		if (h1[k] < 0 || h2[k] < 0 || h1[k] >= (int)ctx.total || h2[k] >= (int)ctx.total){
+			error = "Contact between helices not in the topology!";
+			return false;
+		}
 	}
-	if(!total){
-		cout << "No helices found!" << endl;
-		exit(1);
+
+	// Residue positions are stored by residue number
+	ctx.residue_count = 0;
+	for (unsigned int i = 0; i < ctx.boundaries.size(); i++){
+		if (ctx.boundaries[i] < 0){
+			error = "Negative helix boundary!";
+			return false;
+		}
+		ctx.residue_count = max(ctx.residue_count, (unsigned int)ctx.boundaries[i]+1);
+	}
+	for (unsigned int i = 0; i < ctx.contacts.size(); i++){
+		if (ctx.contacts[i].first < 0 || ctx.contacts[i].second < 0){
+			error = "Negative residue number in contacts!";
+			return false;
+		}
+		ctx.residue_count = max(ctx.residue_count, (unsigned int)max(ctx.contacts[i].first, ctx.contacts[i].second)+1);
 	}
 
 	// Construct graph
@@ -467,59 +947,83 @@ int main(int argc, char* argv[]){
 	 	graph_traits<Graph>::edge_descriptor e;
 		bool inserted;  
          	tie(e, inserted) = add_edge(h1[j],h2[j],g);  
-		weightmap[e] =  1.2;
+		weightmap[e] = EDGE_WEIGHT;
 	}	
  
  	// connected_components
     	vector<unsigned int> component(num_vertices(g));
     	unsigned int num = connected_components(g, &component[0]);
     
-    	if (num > 1) cout << endl << "Graph contains " << num << " components." << endl << endl;
+    	if (num > 1) log << endl << "Graph contains " << num << " components." << endl << endl;
     	
-	//for (i = 0; i != component.size(); ++i){
-      	//	cout << "Vertex " << i <<" is in component " << component[i] << endl;
-    	//}
-	//cout << endl;
+	// Each component is laid out and optimised on its own, with its
+	// helices numbered from 0 in sequence order. local[j] is the number
+	// of helix j within its component.
+	vector<vector<int> > component_helices(num);
+	vector<int> local(component.size());
+	for (unsigned int j = 0; j < component.size(); j++){
+		local[j] = component_helices[component[j]].size();
+		component_helices[component[j]].push_back(j);
+	}
+	vector<vector<int> > component_h1(num), component_h2(num);
+	for (int k = 0; k < edges; k++){
+		component_h1[component[h1[k]]].push_back(local[h1[k]]);
+		component_h2[component[h1[k]]].push_back(local[h2[k]]);
+	}
+
+	// The full topology and contacts, each component gets the helices
+	// and contacts of its own
+	vector<int> all_boundaries = ctx.boundaries;
+	vector<pair<int,int> > all_contacts = ctx.contacts;
+	vector<int> residue_component(ctx.residue_count, -1);
+	for (unsigned int j = 0; j < component.size() && 2*j+1 < all_boundaries.size(); j++){
+		for (int r = all_boundaries[2*j]; r <= all_boundaries[2*j+1]; r++) residue_component[r] = component[j];
+	}
 
  	for (unsigned int i = 0; i < num; i++){
 	
-		if (num > 1) cout << "Processing graph component " << i+1 << "..." << endl << endl; 
+		if (num > 1) log << "Processing graph component " << i+1 << "..." << endl << endl; 
 	
-		Graph G;
+		const vector<int>& original_component_vertices = component_helices[i];
+		vector<int>& component_edges_h1 = component_h1[i];
+		vector<int>& component_edges_h2 = component_h2[i];
+		ctx.total = original_component_vertices.size();
+
+		Graph G(ctx.total);
 		WeightMap component_weightmap = get(edge_weight, G);
-		map<int,int> original_component_vertices;	
-		total = 0;
+		for (unsigned int k = 0; k < component_edges_h1.size(); k++){
+			graph_traits<Graph>::edge_descriptor e;
+			bool inserted;
+			tie(e, inserted) = add_edge(component_edges_h1[k], component_edges_h2[k], G);
+			component_weightmap[e] = EDGE_WEIGHT;
+		}
 
-    		for (unsigned int j = 0; j != component.size(); ++j){				
-			if (i == component[j]){
-			
-				if (num > 1) cout << "Helix " << j+1 <<" is in component " << component[j]+1 << endl;
-				original_component_vertices[total] = j;
-				
-      				for (int k = 0; k < edges; ++k){
-					if ((j == (unsigned int)h1[k] && component[h2[k]] == component[j])||(j == (unsigned int)h2[k] && component[h1[k]] == component[j])){
-	 					graph_traits<Graph>::edge_descriptor  e;
-						bool inserted;  
-         					tie(e, inserted) = add_edge(h1[k],h2[k],G);  
-						component_weightmap[e] =  1.2;
-						//cout << "Edge: " << h1[k]+1 << " => " << h2[k]+1 << endl;
-					}
-				}
-				total++;			
-			}			
-		}	
+		ctx.boundaries.clear();
+		for (unsigned int j = 0; j < ctx.total; j++){
+			int helix = original_component_vertices[j];
+			if (num > 1) log << "Helix " << helix+1 <<" is in component " << i+1 << endl;
+			ctx.boundaries.push_back(all_boundaries[2*helix]);
+			ctx.boundaries.push_back(all_boundaries[2*helix+1]);
+		}
+
+		// Contacts with neither residue in this component's helices
+		// would only add zero distances
+		ctx.contacts.clear();
+		for (unsigned int c = 0; c < all_contacts.size(); c++){
+			if (residue_component[all_contacts[c].first] == (int)i || residue_component[all_contacts[c].second] == (int)i) ctx.contacts.push_back(all_contacts[c]);
+		}
  
   		PositionVec position_vec(num_vertices(G));  	
   		PositionMap position(position_vec.begin(), get(vertex_index, G));
 		minstd_rand gen;
 		double radius = 300;
-		if (total >= 5) radius = 500;
-		if (total >= 10) radius = 800;
+		if (ctx.total >= 5) radius = 500;
+		if (ctx.total >= 10) radius = 800;
 
 		// For some reason the KK algorithm seems to get stuck when
 		// we have 5 helices arranged in a circle, so randomise the
 		// initial arrangement rather than arrange in a circle
-		if (total == 5){			
+		if (ctx.total == 5){			
 			//cout << "Random layout:" << endl;
 			random_graph_layout(G, position, 0, (int)width, 0, (int)height, gen);
   		}else{	
@@ -527,15 +1031,68 @@ int main(int argc, char* argv[]){
 			circle_graph_layout(G, position, radius);
 		}
 
-		cout << endl << "Calculating layout..." << endl << endl;
+		log << endl << "Calculating layout..." << endl << endl;
 		double edge_width = 590;
 
-		if (total >= 4){	
-				
-			kamada_kawai_spring_layout(G, position, component_weightmap, edge_length(edge_width)); 		
+		if (ctx.total >= 4){	
+
+			auto lay_out = [&](const Graph& g, PositionVec& positions){
+				if (options.starts > 1){
+					multi_start_layout(g, options.engine, options.starts, ctx.threads, options.iterations, options.tolerance, seed, width, height, edge_width, positions, log);
+				}else{
+					int iterations = run_layout(g, options.engine, options.iterations, options.tolerance, edge_width, positions);
+					double energy;
+					if (options.engine == LAYOUT_SMACOF && layout_energy(graph_edges(g), edge_width, positions, energy)){
+						log << "Stress majorisation: energy " << energy << " after " << iterations << " iterations";
+						if (iterations >= options.iterations) log << ", stopped at the iteration limit";
+						log << endl << endl;
+					}
+				}
+			};
+
+			// With a layout cache the helices are laid out in canonical
+			// order, from the starting positions of that order, so every
+			// graph of the same shape gets the same layout
+			vector<int> canon;
+			string graph_key;
+			if (!options.layout_cache.empty() && canonical_labelling(ctx.total, graph_edges(G), canon, graph_key)){
+				ostringstream text;
+				text << "layout " << graph_key << " " << options.engine << " " << options.starts << " " << options.iterations << " " << options.tolerance << " " << edge_width;
+				if (options.starts > 1) text << " " << seed;
+				string key = hash_key(text.str());
+
+				PositionVec canonical_vec(position_vec);
+				vector<double> stored;
+				if (cached_layout(options.layout_cache, key, stored) && stored.size() == 2*ctx.total){
+					for (unsigned int v = 0; v < ctx.total; v++){
+						canonical_vec[v].x = stored[2*v];
+						canonical_vec[v].y = stored[2*v+1];
+					}
+					log << "Layout taken from the layout cache." << endl << endl;
+				}else{
+					Graph canonical_G(ctx.total);
+					WeightMap canonical_weightmap = get(edge_weight, canonical_G);
+					for (unsigned int k = 0; k < component_edges_h1.size(); k++){
+						graph_traits<Graph>::edge_descriptor e;
+						bool inserted;
+						tie(e, inserted) = add_edge(canon[component_edges_h1[k]], canon[component_edges_h2[k]], canonical_G);
+						canonical_weightmap[e] = EDGE_WEIGHT;
+					}
+					lay_out(canonical_G, canonical_vec);
+					stored.clear();
+					for (unsigned int v = 0; v < ctx.total; v++){
+						stored.push_back(canonical_vec[v].x);
+						stored.push_back(canonical_vec[v].y);
+					}
+					cache_layout(options.layout_cache, key, stored);
+				}
+				for (unsigned int v = 0; v < ctx.total; v++) position_vec[v] = canonical_vec[canon[v]];
+			}else{
+				lay_out(G, position_vec);
+			}
 			
-			if (num == 1 && (unsigned int)edges == total-1){
-				cout << "Linear helix arrangment detected. Using circular layout..." << endl;				
+			if (num == 1 && (unsigned int)edges == ctx.total-1){
+				log << "Linear helix arrangment detected. Using circular layout..." << endl;				
 				double x_centre = position[0].x;
 				double y_centre = position[0].y - radius;
 				double t = -90;	
@@ -543,80 +1100,209 @@ int main(int argc, char* argv[]){
 				map<double,int>::iterator it_h1;				
 				// KK will put helices in a line, sort by x coord and use to make a circle
 				// without any edge crossings
-				for (unsigned int c = 0; c < total; c++){
+				for (unsigned int c = 0; c < ctx.total; c++){
 					helix_x_positions[position[c].x] = c;
 				}
 				for (it_h1 = helix_x_positions.begin(); it_h1 != helix_x_positions.end(); it_h1++){
 					if (t > 360) t -= 360;				
 					position[(*it_h1).second].x = x_centre + radius*cos(t*M_PI/180);
 					position[(*it_h1).second].y = y_centre + radius*sin(t*M_PI/180);				
-					t += 360.0/total;			
+					t += 360.0/ctx.total;			
 				
 				}
 			}else{
-				cout << "Using Kamada-Kawai spring layout..." << endl;
+				log << "Using Kamada-Kawai spring layout..." << endl;
 			}			
 		}
 	
-		for (unsigned int i = 0; i < total; i++){
-			pair <double,double> helix_xy (position[i].x, position[i].y);		
-			helix_positions[i] = helix_xy;	
+		xy_array helix_positions;
+		helix_positions.resize(ctx.total);
+		for (unsigned int i = 0; i < ctx.total; i++){
+			helix_positions.x[i] = position[i].x;
+			helix_positions.y[i] = position[i].y;
 		}	
 
-		all_helix_positions.push_back(helix_positions);	
-		if(total > 4){
-			cout << endl << "Generating loop crossover scores for alternate arrangements..." << endl;
-			swap_helices(total,h1,h2,0);
-			cout << endl;
+		ctx.all_helix_positions.push_back(helix_positions);	
+		if(ctx.total > 4){
+			log << endl << "Generating loop crossover scores for alternate arrangements..." << endl;
+
+			// The swaps depend on which helices follow each other in
+			// sequence, so they are kept for the graph in sequence order
+			// and the exact layout they started from
+			string key;
+			if (!options.layout_cache.empty()){
+				ostringstream text;
+				text.precision(17);
+				text << "swaps " << ctx.total;
+				for (unsigned int k = 0; k < component_edges_h1.size(); k++) text << " " << component_edges_h1[k] << "," << component_edges_h2[k];
+				for (unsigned int h = 0; h < ctx.total; h++) text << " " << helix_positions.x[h] << "," << helix_positions.y[h];
+				key = hash_key(text.str());
+			}
+			vector<double> stored;
+			if (!key.empty() && cached_layout(options.layout_cache, key, stored) && stored.size() % (2*ctx.total) == 0){
+				ctx.all_helix_positions.clear();
+				for (unsigned int k = 0; k < stored.size(); k += 2*ctx.total){
+					xy_array arrangement;
+					arrangement.x.assign(stored.begin() + k, stored.begin() + k + ctx.total);
+					arrangement.y.assign(stored.begin() + k + ctx.total, stored.begin() + k + 2*ctx.total);
+					ctx.all_helix_positions.push_back(arrangement);
+				}
+				log << "Alternate arrangements taken from the layout cache." << endl;
+			}else{
+				ctx.helix_swaps_seen.assign(ctx.total*ctx.total, false);
+				start_arrangements(ctx.arrangements_seen, ctx.all_helix_positions[0]);
+				ctx.arrangements_seen.seen.insert(arrangement_hash(ctx, 0));
+				swap_helices(ctx,component_edges_h1,component_edges_h2,0);
+				remove_duplicate_arrangements(ctx);
+				if (!key.empty()){
+					stored.clear();
+					for (unsigned int a = 0; a < ctx.all_helix_positions.size(); a++){
+						stored.insert(stored.end(), ctx.all_helix_positions[a].x.begin(), ctx.all_helix_positions[a].x.end());
+						stored.insert(stored.end(), ctx.all_helix_positions[a].y.begin(), ctx.all_helix_positions[a].y.end());
+					}
+					cache_layout(options.layout_cache, key, stored);
+				}
+			}
+			log << endl;
 		}	
 		
-		map<double,int> scores;	
-		double score = 0;
-	
-		for (unsigned int a = 0; a < all_helix_positions.size(); a++){		
-			vector<int> rotations;
-			for (unsigned int i = 0; i < total; i++){
-				rotations.push_back(0);	
+		unsigned int arrangements = ctx.all_helix_positions.size();
+
+		// Every arrangement of every component gets its own stream
+		vector<unsigned long long> streams(arrangements);
+		vector<string> keys(arrangements);
+		for (unsigned int a = 0; a < arrangements; a++){
+			streams[a] = seed++;
+			if (!cache_file.empty()) keys[a] = arrangement_key(ctx, a);
+		}
+
+		vector<double> arrangement_scores(arrangements);
+		vector<string> reports(arrangements);
+
+		// The best arrangements so far by score, the worst at the top of
+		// the heap. Arrangements with equal scores are reported once, as
+		// the later one, so the result doesn't depend on the order they
+		// finish in. With options.top only that many are kept, the
+		// positions and rotations of the others are released as soon as
+		// they have been optimised.
+		unsigned int top = options.top ? options.top : arrangements;
+		vector<pair<double,int> > kept;
+		rotation_cache optimised;
+		mutex kept_mutex;
+		vector<vector<int> > best_rotations(arrangements, vector<int>(ctx.total));
+		auto worse = [](const pair<double,int>& a, const pair<double,int>& b){ return a.first < b.first; };
+		auto retain = [&](unsigned int a){
+			double score = arrangement_scores[a]/h1.size();
+			lock_guard<mutex> lock(kept_mutex);
+			if (!cache_file.empty()) optimised[keys[a]] = best_rotations[a];
+			int released = a;
+			vector<pair<double,int> >::iterator same = kept.begin();
+			while (same != kept.end() && same->first != score) same++;
+			if (same != kept.end()){
+				if ((int)a > same->second){
+					released = same->second;
+					same->second = a;
+				}
+			}else if (kept.size() < top){
+				kept.push_back(make_pair(score, (int)a));
+				push_heap(kept.begin(), kept.end(), worse);
+				released = -1;
+			}else if (score < kept.front().first){
+				pop_heap(kept.begin(), kept.end(), worse);
+				released = kept.back().second;
+				kept.back() = make_pair(score, (int)a);
+				push_heap(kept.begin(), kept.end(), worse);
 			}
-			all_rotations.push_back(rotations);
-		
-			r_xy_map residue_positions;
-			all_residue_positions.push_back(residue_positions);
-				
-			for (unsigned int i = 0; i < total; i++){
-				get_residue_positions(all_rotations[a][i], i, a);
-			}		
-			cout << "Optimising helix rotation..." << endl << endl;
-			score = optimise_parameters(total,a)/h1.size();
-			scores[score] = a;
-			cout << endl;	
-		}
-
-		int count = 1;
-		map<double,int>::iterator it_h1;
-		for (it_h1 = scores.begin(); it_h1 != scores.end(); it_h1++){
-			//cout << "----" << (*it_h1).first << "--->" << (*it_h1).second << endl;
-			//cout << "Arrangement " << count << " (" << (*it_h1).second << ")" << endl;
-			if (scores.size() > 1) cout << "Arrangement " << count << endl;
-			cout << "Helix\tPosition\t\tRotation" << endl;
-			for (unsigned int i = 0; i < total; i++){
-				cout << original_component_vertices[i]+1 << "\t(" << all_helix_positions[(*it_h1).second][i].first << "," << all_helix_positions[(*it_h1).second][i].second << ")\t" << all_rotations[(*it_h1).second][i] << endl;
+			if (released < 0) return;
+			ctx.all_helix_positions[released].release();
+
+			// The warm starts of the other arrangements need these
+			if (!(options.warm_start && released == 0)) vector<int>().swap(best_rotations[released]);
+		};
+
+		// Warm starts from the previous best of the same arrangement
+		// and, for the swapped arrangements, the best of the original
+		auto optimise = [&](unsigned int a, int threads){
+			Engine* e = engine_new(settings, ctx.all_helix_positions[a], ctx.boundaries, ctx.contacts, ctx.residue_count, streams[a]);
+			vector<int> cached;
+			if (!cache_file.empty() && cached_rotations(cache_file, keys[a], cached) && cached.size() == ctx.total) engine_hint(e, &cached[0]);
+			if (options.warm_start && a > 0) engine_hint(e, &best_rotations[0][0]);
+			arrangement_scores[a] = engine_run(e, threads, reports[a]);
+			engine_best(e, &best_rotations[a][0]);
+			engine_free(e);
+			retain(a);
+		};
+
+		unsigned int first = 0;
+		if (options.warm_start && arrangements > 1){
+			optimise(0, ctx.threads);
+			first = 1;
+		}
+
+		// The other arrangements are independent, so they are optimised
+		// at once and share out the threads
+		unsigned int workers = max(1u, min((unsigned int)ctx.threads, arrangements - first));
+		int threads_each = max(1, ctx.threads / (int)workers);
+		{
+			work_queue pool(workers);
+			for (unsigned int a = first; a < arrangements; a++){
+				pool.push([&optimise, a, threads_each](){ optimise(a, threads_each); });
 			}
-			cout << "Score:\t" << (*it_h1).first << endl;
-       			cout << "========================================" << endl;
-			cout << endl;	
-			count++;	
+			pool.wait();
+		}
+		if (!cache_file.empty()) cache_rotations(cache_file, optimised);
+
+		for (unsigned int a = 0; a < arrangements; a++){
+			log << "Optimising helix rotation..." << endl << endl;
+			log << reports[a];
+			log << endl;	
 		}
- 
 
-		helix_positions.clear();
-		all_helix_positions.clear();
-		helix_swaps_seen.clear();
-		all_rotations.clear();
-		all_residue_positions.clear();	
-		original_component_vertices.clear();
+		layout_component component_result;
+		sort_heap(kept.begin(), kept.end(), worse);
+		for (unsigned int k = 0; k < kept.size(); k++){
+			int a = kept[k].second;
+			layout_arrangement arrangement;
+			for (unsigned int i = 0; i < ctx.total; i++){
+				placed_helix helix = {original_component_vertices[i]+1, ctx.all_helix_positions[a].x[i], ctx.all_helix_positions[a].y[i], best_rotations[a][i]};
+				arrangement.helices.push_back(helix);
+			}
+			arrangement.score = kept[k].first;
+			component_result.arrangements.push_back(arrangement);
+		}
+		result.components.push_back(component_result);
+
+		ctx.all_helix_positions.clear();
+		ctx.helix_swaps_seen.clear();
+		ctx.arrangements_seen = arrangement_set();
 	}
-	
-  	return 1;
+	return true;
 }
 
+bool save_layout_caches(ostream& log){
+
+	vector<string> rotation_failed, layout_failed;
+	bool ok = flush_rotation_caches(rotation_failed);
+	ok = flush_layout_caches(layout_failed) && ok;
+	for (unsigned int f = 0; f < rotation_failed.size(); f++) log << "Couldn't write rotation cache " << rotation_failed[f] << endl;
+	for (unsigned int f = 0; f < layout_failed.size(); f++) log << "Couldn't write layout cache " << layout_failed[f] << endl;
+	return(ok);
+}
+
+void write_layout_result(ostream& os, const layout_result& result){
+
+	for (unsigned int c = 0; c < result.components.size(); c++){
+		const vector<layout_arrangement>& arrangements = result.components[c].arrangements;
+		for (unsigned int a = 0; a < arrangements.size(); a++){
+			if (arrangements.size() > 1) os << "Arrangement " << a+1 << endl;
+			os << "Helix\tPosition\t\tRotation" << endl;
+			for (unsigned int i = 0; i < arrangements[a].helices.size(); i++){
+				const placed_helix& h = arrangements[a].helices[i];
+				os << h.helix << "\t(" << h.x << "," << h.y << ")\t" << h.rotation << endl;
+			}
+			os << "Score:\t" << arrangements[a].score << endl;
+       			os << "========================================" << endl;
+			os << endl;	
+		}
+	}
+}
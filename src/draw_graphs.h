@@ -18,5 +18,40 @@
 // proteins based on multiple sequence profiles.
 // 
 
+#ifndef DRAW_GRAPHS_H
+#define DRAW_GRAPHS_H
+
+#include "globals.h"
+
+// Residue positions of every helix of an arrangement at every
+// whole-degree rotation, so that scoring a set of rotations needs no
+// trigonometry, and the contacts that touch each helix. The tables
+// hold their own copy of the helix boundaries, helix positions and
+// contacts, so each rotation optimisation has everything it reads and
+// arrangements can be optimised at once.
+struct rotation_tables {
+	vector<int> boundaries;
+	xy_array helix_positions;
+	vector<pair<int,int> > contacts;
+	vector<int> helix_of;
+	vector<vector<double> > x, y;
+	vector<vector<unsigned int> > helix_contacts;
+	vector<pair<int,int> > contact_helices;
+};
+
+// Rotation sets scored together by batch_rotation_scores
+#define ROTATION_LANES 8
+
 double distance_rr(double, double, double, double);
-double optimise_rotation(int);
+
+// Tables for the helices at helix_positions with the given boundaries
+// (start and end residue of each helix) and contacts, residue numbers
+// below residue_count
+void prepare_rotation_tables(rotation_tables&, const xy_array& helix_positions, const vector<int>& boundaries, const vector<pair<int,int> >& contacts, unsigned int residue_count);
+double update_rotation_score(const rotation_tables&, const int*, int*, double*, bool);
+void batch_rotation_scores(const rotation_tables&, const int* const*, double* const*, int, double*);
+double helix_contact_distance(const rotation_tables&, int, int*, int);
+int residue_helix(const rotation_tables&, int);
+double contact_distance(const rotation_tables&, unsigned int, const int*);
+
+#endif
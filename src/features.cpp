@@ -0,0 +1,275 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: SVM feature generation for the lipid exposure and
+// residue contact models. This is a port of load_mtx,
+// create_lipid_input and create_contact_input from run_mempack.pl
+// and produces exactly the feature vectors the script writes to
+// its .dat files.
+//
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <math.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "features.h"
+
+using namespace std;
+
+static const int window = 7;
+static const double dp = 0.0001;
+
+// Profile normalisation values (get_normalisation_values in run_mempack.pl)
+static const double norm_mean[28] = {
+	-32768, -65.7855796773707, -32768, -263.751620684456, -242.89740690487,
+	-194.765716870194, -135.345507311925, -192.372795115332, -221.253316749585, -92.5749283883612,
+	-179.119704507764, -89.1816674204734, -88.3949193426805, -188.69587667722, -249.184494195688,
+	-162.548130559325, -207.047225991256, -90.7070707070707, -86.9080732700136, -80.3608095884215,
+	-278.93061209106, -100, -167.07315694256, -32768, -32768,
+	-401.752826775215, -32768, -32768
+};
+static const double norm_sd[28] = {
+	1, 165.265945369071, 1, 123.206910338565, 188.205050583637,
+	180.643157809653, 251.687254013587, 230.165335412046, 155.427737434726, 246.71482166236,
+	167.0612436708, 236.538032097989, 185.952348451384, 183.448068516649, 178.122836782516,
+	164.437104518497, 173.171717333037, 163.603610103856, 145.736036521422, 211.306064426292,
+	192.05331159166, 1, 185.875809713378, 1, 1,
+	3.56447071169638, 1, 1
+};
+static const double norm_lower[28] = {
+	0, -2.67577460882869, 0, -3.37844994385232, -2.4234343960522,
+	-2.38168048182125, -2.19182530656994, -2.14466354805761, -2.65555357147081, -2.51474584068856,
+	-2.51931738471669, -2.59078139419735, -2.88033512412105, -2.52008171610062, -2.32320298328491,
+	-2.5690787409429, -2.25182714599291, -2.83791371717405, -2.80021288125261, -2.69106895703854,
+	-2.45801222585864, 0, -2.53355637715103, 0, 0,
+	-11.8522991607579, 0, 0
+};
+static const double norm_range[28] = {
+	1, 7.21866805248836, 33266, 14.6014537257403, 8.16131126787913,
+	7.70026397271977, 6.25379305030295, 6.27375098606802, 11.059801991404, 5.84885816862194,
+	8.38016028875466, 5.66505093542372, 8.53444451342817, 8.25846798088533, 8.67378954831272,
+	8.89093738472843, 8.24615024896777, 7.82990056996184, 8.56342761741401, 6.35097721233704,
+	10.5647748699799, 1, 8.69397692196679, 33219, 32687,
+	15.1495142947326, 32687, 33113
+};
+
+// The 20 amino acid columns of the 28 column .mtx profile
+static const int aa_columns[20] = {1,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,21,22};
+
+// Round.pm's one half, a little larger than 0.5 so that halves
+// printed in decimal still round up
+static double round_half(){
+
+	double h = 0.5;
+	unsigned char bytes[sizeof(double)];
+	memcpy(bytes, &h, sizeof(double));
+	if (bytes[0] != 0 && bytes[sizeof(double)-1] == 0){
+		// Big-endian
+		bytes[sizeof(double)-2] = 0x10;
+		bytes[sizeof(double)-1] = 0x00;
+	}else{
+		// Little-endian
+		bytes[0] = 0x00;
+		bytes[1] = 0x10;
+	}
+	memcpy(&h, bytes, sizeof(double));
+	return(h);
+}
+
+// Set before main, so the feature workers only ever read it
+static const double half = round_half();
+
+// Round::nearest_ceil, including its slightly-larger-than-one-half
+static double nearest_ceil(double targ, double x){
+
+	return(targ * floor((x + half * targ) / targ));
+}
+
+// The value the SVM sees after Perl has printed x into the .dat file
+static double perl_number(double x){
+
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.15g", x);
+	return(strtod(buf, NULL));
+}
+
+bool load_profile(const string& mtx_file, profile_t& profile){
+
+	ifstream is(mtx_file.c_str());
+	if(!is.good()) return false;
+
+	vector<string> mtx;
+	string line;
+	while(getline(is,line)){
+		mtx.push_back(line);
+	}
+	is.close();
+	if (mtx.size() < 2) return false;
+
+	profile.length = atoi(mtx[0].c_str());
+	profile.sequence.clear();
+	for (unsigned int i = 0; i < mtx[1].size(); i++){
+		if (!isspace(mtx[1][i])) profile.sequence += mtx[1][i];
+	}
+	if (profile.length <= 0) return false;
+
+	int half_window = (window-1)/2;
+	profile.rows.assign(profile.length + window, vector<double>());
+
+	for (int k = 1; k <= profile.length + window - 1; k++){
+
+		// Missing
+		if (k <= half_window || k > profile.length + half_window) continue;
+
+		// Start on MTX line 15
+		unsigned int l = k + 13 - half_window;
+		if (l >= mtx.size()) continue;
+
+		// split(/\s+/) keeps a leading empty field
+		vector<string> fields;
+		const string& row = mtx[l];
+		unsigned int p = 0;
+		if (p < row.size() && isspace(row[p])){
+			fields.push_back("");
+			while (p < row.size() && isspace(row[p])) p++;
+		}
+		while (p < row.size()){
+			unsigned int q = p;
+			while (q < row.size() && !isspace(row[q])) q++;
+			fields.push_back(row.substr(p, q-p));
+			while (q < row.size() && isspace(row[q])) q++;
+			p = q;
+		}
+		if (fields.size() <= (unsigned int)aa_columns[19]) return false;
+
+		// Z score normalisation, scaling and rounding to 4 decimal places
+		vector<double>& values = profile.rows[k];
+		for (int a = 0; a < 20; a++){
+			int c = aa_columns[a];
+			double z = atof(fields[c].c_str());
+			z = (z - norm_mean[c]) / norm_sd[c];
+			z = (z + (-1 * norm_lower[c])) / norm_range[c];
+			values.push_back(perl_number(nearest_ceil(dp, z)));
+		}
+	}
+	return true;
+}
+
+char window_residue(const profile_t& profile, int pos){
+
+	if (pos < 1 || pos > profile.length || pos > (int)profile.sequence.size()) return 'X';
+	return(profile.sequence[pos-1]);
+}
+
+static void add_word(vector<WORD>& words, double value){
+
+	WORD w;
+	w.wnum = words.size() + 1;
+	w.weight = (FVAL)value;
+	words.push_back(w);
+}
+
+static void end_words(vector<WORD>& words){
+
+	WORD w;
+	w.wnum = 0;
+	w.weight = 0;
+	words.push_back(w);
+}
+
+// Profile rows for the window around pos; positions without a row
+// contribute no features at all, as in the Perl version
+static void add_window(const profile_t& profile, int pos, vector<WORD>& words){
+
+	int pos0 = pos - 1;
+	for (int k = pos0 - (window-1)/2; k <= pos0 + (window-1)/2; k++){
+		if (k < 0 || k >= (int)profile.rows.size()) continue;
+		const vector<double>& row = profile.rows[k];
+		for (unsigned int i = 0; i < row.size(); i++){
+			add_word(words, row[i]);
+		}
+	}
+}
+
+void lipid_features(const profile_t& profile, int pos, vector<WORD>& words){
+
+	words.clear();
+	add_window(profile, pos, words);
+	end_words(words);
+}
+
+void contact_features(const profile_t& profile, const contact_residue& r1, const contact_residue& r2, vector<WORD>& words){
+
+	words.clear();
+	add_window(profile, r1.pos, words);
+	add_window(profile, r2.pos, words);
+
+	// Relative position in each helix, measured from the same membrane side
+	double relative_pos1 = (double)r1.helix_pos/r1.helix_length;
+	if (!(r1.helix % 2)) relative_pos1 = 1 - relative_pos1;
+	double relative_pos2 = (double)r2.helix_pos/r2.helix_length;
+	if (!(r2.helix % 2)) relative_pos2 = 1 - relative_pos2;
+	add_word(words, perl_number(nearest_ceil(dp, relative_pos1)));
+	add_word(words, perl_number(nearest_ceil(dp, relative_pos2)));
+
+	// Sequence separation in bins of 25
+	int distance = r2.pos - r1.pos;
+	add_word(words, distance <= 25 ? 1 : 0);
+	for (int bin = 1; bin < 8; bin++){
+		add_word(words, (distance > bin*25 && distance <= (bin+1)*25) ? 1 : 0);
+	}
+	add_word(words, distance > 200 ? 1 : 0);
+
+	add_word(words, r1.lipid);
+	add_word(words, r2.lipid);
+	end_words(words);
+}
+
+double classify_words(MODEL* model, const vector<WORD>& words){
+
+	vector<WORD> doc_words(words);
+
+	// Remove features the linear model does not know about
+	if (model->kernel_parm.kernel_type == 0){
+		for (unsigned int j = 0; doc_words[j].wnum != 0; j++){
+			if (doc_words[j].wnum > model->totwords){
+				doc_words[j].wnum = 0;
+				break;
+			}
+		}
+	}
+
+	char comment[1] = {0};
+	DOC* doc = create_example(-1,0,0,0.0,create_svector(&doc_words[0],comment,1.0));
+	double dist;
+	if (model->kernel_parm.kernel_type == 0){
+		dist = classify_example_linear(model,doc);
+	}else{
+		dist = classify_example(model,doc);
+	}
+	free_example(doc,1);
+	return(dist);
+}
+
+string format_score(double dist){
+
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.8g", dist);
+	return(string(buf));
+}
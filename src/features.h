@@ -0,0 +1,71 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: SVM feature generation for the lipid exposure and
+// residue contact models. This is a port of load_mtx,
+// create_lipid_input and create_contact_input from run_mempack.pl
+// and produces exactly the feature vectors the script writes to
+// its .dat files.
+//
+
+#ifndef FEATURES_H
+#define FEATURES_H
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "svm_common.h"
+}
+
+using namespace std;
+
+// Normalised PSI-BLAST profile, indexed like %profile in run_mempack.pl:
+// key k holds residue k-3 and keys outside the sequence are empty
+struct profile_t {
+	int length;
+	string sequence;
+	vector<vector<double> > rows;
+};
+
+bool load_profile(const string& mtx_file, profile_t& profile);
+
+// Residue in the window centre, 'X' outside the sequence
+char window_residue(const profile_t& profile, int pos);
+
+// Lipid exposure features for residue pos (1-based). words is
+// terminated with a zero wnum, ready for create_svector.
+void lipid_features(const profile_t& profile, int pos, vector<WORD>& words);
+
+// One residue of a contact pair: its position, the 1-based helix it
+// belongs to, its 1-based position in that helix and the helix length
+struct contact_residue {
+	int pos;
+	int helix;
+	int helix_pos;
+	int helix_length;
+	double lipid;
+};
+
+void contact_features(const profile_t& profile, const contact_residue& r1, const contact_residue& r2, vector<WORD>& words);
+
+// Decision value of model for a zero-terminated feature vector, with
+// the same handling of linear models as svm_classify
+double classify_words(MODEL* model, const vector<WORD>& words);
+
+// Decision values are passed between stages as text, exactly as
+// svm_classify writes them and run_mempack.pl reads them back
+string format_score(double dist);
+
+#endif
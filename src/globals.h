@@ -23,20 +23,60 @@
 #define GLOBALS_H
 
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
+#include <unordered_set>
 
 using namespace std;
 
-typedef map<const pair<int,int>, const pair<int,int> > rr_hh_map;
-typedef map<const int, pair<double,double> > r_xy_map;
-extern unsigned int total;
-extern map<const int, pair<double,double> > helix_positions;
-extern vector< map<const int, pair<double,double> > > all_helix_positions;
-extern map<const string,int> helix_swaps_seen;
-extern vector<int> boundaries;
-extern vector<vector<int> > all_rotations;
-extern rr_hh_map residues_to_helices;
-extern vector<r_xy_map> all_residue_positions;
+// x and y coordinates as two flat arrays, used for the helix centres
+// of an arrangement (indexed by helix) and the residue positions of
+// an arrangement (indexed by residue number)
+struct xy_array {
+	vector<double> x, y;
+	void resize(unsigned int n){ x.assign(n, 0.0); y.assign(n, 0.0); }
+	void release(){ vector<double>().swap(x); vector<double>().swap(y); }
+};
+
+// Arrangements enumerated so far. Arrangements only exchange the
+// positions of the original layout, so one is the permutation giving
+// each helix its position, positions numbered in sorted order.
+// Permutations that differ by a rotation or mirror image taking the
+// layout onto itself are the same arrangement; each arrangement is
+// kept as a 64 bit hash of the smallest of them.
+struct arrangement_set {
+	vector<pair<double,double> > positions;
+	vector<vector<int> > symmetries;
+	unordered_set<unsigned long long> seen;
+};
+
+// Working state of one layout call. Each call has its own, so layouts
+// can run at once.
+struct layout_context {
+
+	// Helices of the current component, the positions of each of its
+	// arrangements, and its helix boundaries and contacts
+	unsigned int total;
+	vector<xy_array> all_helix_positions;
+	vector<int> boundaries;
+
+	// Predicted residue-residue contacts, sorted and without duplicates
+	vector<pair<int,int> > contacts;
+
+	// Largest residue number in the topology or the contacts, plus one
+	unsigned int residue_count;
+
+	// Helix pairs (h*total + j) already swapped on the way to the current
+	// arrangement, and every arrangement enumerated so far
+	vector<bool> helix_swaps_seen;
+	arrangement_set arrangements_seen;
+
+	// Threads the call may use, and whether it reports the helix swaps
+	int threads;
+	bool verbose;
+
+	layout_context() : total(0), residue_count(0), threads(1), verbose(false) {}
+};
 
 #endif
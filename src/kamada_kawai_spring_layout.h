@@ -198,13 +198,9 @@ namespace boost {
           }
         }
 
-	int iterations = 0;
+	// kk_plot's done functor (layout_budget) gives up after a set
+	// number of iterations, in case we get stuck in this loop
         while (!done(delta_p, p, g, true)){
-		
-		// Hack to get out of here if we get stuck in this loop
-		//std::cout << iterations << std::endl;
-		if(iterations > 200000) return true;
-		iterations++;
 	
           // The contribution p makes to the partial derivatives of
           // each vertex. Computing this (at O(n) cost) allows us to
@@ -0,0 +1,298 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Kamada-Kawai spring layout for graphs whose edges all
+// have the same weight, as the helix contact graphs of kk_plot do.
+// It takes the same steps as kamada_kawai_spring_layout.h, but finds
+// the graph distances by breadth first search, keeps the distance and
+// spring matrices and the positions in flat arrays and works out the x
+// and y terms of each spring together in SIMD lanes.
+//
+// The sums over vertices are added up in the same order as in the
+// Boost version, so the layouts are the same. Adding them up in
+// another order is enough to send larger graphs to a different local
+// minimum.
+//
+
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "kk_layout.h"
+
+using namespace std;
+
+// Same tolerance as the Boost version
+#define KK_TOLERANCE 0.001
+
+struct spring_system {
+
+	unsigned int n;
+
+	// x and y of vertex v at 2v and 2v+1, so both go through one SIMD
+	// register
+	vector<double> xy;
+
+	// Row major
+	vector<double> distance, strength;
+};
+
+// Derivative of the energy at m from the spring between m and i
+static inline void partial(const spring_system& s, unsigned int m, unsigned int i, double& dx, double& dy){
+
+	dx = dy = 0;
+	if (i == m) return;
+	double x_diff = s.xy[2*m] - s.xy[2*i];
+	double y_diff = s.xy[2*m+1] - s.xy[2*i+1];
+	double dist = sqrt(x_diff * x_diff + y_diff * y_diff);
+	double k = s.strength[m*s.n + i];
+	double l = s.distance[m*s.n + i];
+	dx = k * (x_diff - l*x_diff/dist);
+	dy = k * (y_diff - l*y_diff/dist);
+}
+
+// Derivatives of the energy at m, summed over every spring. The sums
+// are added up in vertex order, as in the Boost version.
+static void partials(const spring_system& s, unsigned int m, double& dx, double& dy){
+
+	const double* k = &s.strength[m*s.n];
+	const double* l = &s.distance[m*s.n];
+#ifdef __SSE2__
+	__m128d pm = _mm_loadu_pd(&s.xy[2*m]);
+	__m128d sum = _mm_setzero_pd();
+	for (unsigned int i = 0; i < s.n; i++){
+		if (i == m) continue;
+		__m128d diff = _mm_sub_pd(pm, _mm_loadu_pd(&s.xy[2*i]));
+		__m128d sq = _mm_mul_pd(diff, diff);
+		double dist = sqrt(_mm_cvtsd_f64(sq) + _mm_cvtsd_f64(_mm_unpackhi_pd(sq, sq)));
+		__m128d stretch = _mm_div_pd(_mm_mul_pd(_mm_set1_pd(l[i]), diff), _mm_set1_pd(dist));
+		sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(k[i]), _mm_sub_pd(diff, stretch)));
+	}
+	dx = _mm_cvtsd_f64(sum);
+	dy = _mm_cvtsd_f64(_mm_unpackhi_pd(sum, sum));
+#else
+	dx = dy = 0;
+	for (unsigned int i = 0; i < s.n; i++){
+		double pdx, pdy;
+		partial(s, m, i, pdx, pdy);
+		dx += pdx;
+		dy += pdy;
+	}
+#endif
+}
+
+// Second derivatives of the energy at p, d2E/dxdy and d2E/dydx are equal
+static void second_partials(const spring_system& s, unsigned int p, double& dxdx, double& dxdy, double& dydy){
+
+	const double* k = &s.strength[p*s.n];
+	const double* l = &s.distance[p*s.n];
+	dxdy = 0;
+#ifdef __SSE2__
+	__m128d pp = _mm_loadu_pd(&s.xy[2*p]);
+	__m128d one = _mm_set1_pd(1.0);
+	__m128d sum = _mm_setzero_pd();
+	for (unsigned int i = 0; i < s.n; i++){
+		if (i == p) continue;
+		__m128d diff = _mm_sub_pd(pp, _mm_loadu_pd(&s.xy[2*i]));
+		__m128d sq = _mm_mul_pd(diff, diff);
+		double x_diff = _mm_cvtsd_f64(diff);
+		double y_diff = _mm_cvtsd_f64(_mm_unpackhi_pd(diff, diff));
+		double dist = sqrt(_mm_cvtsd_f64(sq) + _mm_cvtsd_f64(_mm_unpackhi_pd(sq, sq)));
+		double dist_cubed = dist * dist * dist;
+
+		// y,x against x,y gives d2E/dx2 in the low lane and d2E/dy2 in the high
+		__m128d swapped = _mm_shuffle_pd(diff, diff, 1);
+		__m128d bend = _mm_div_pd(_mm_mul_pd(_mm_mul_pd(_mm_set1_pd(l[i]), swapped), swapped), _mm_set1_pd(dist_cubed));
+		sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(k[i]), _mm_sub_pd(one, bend)));
+		dxdy += k[i] * l[i] * x_diff * y_diff / dist_cubed;
+	}
+	dxdx = _mm_cvtsd_f64(sum);
+	dydy = _mm_cvtsd_f64(_mm_unpackhi_pd(sum, sum));
+#else
+	dxdx = dydy = 0;
+	for (unsigned int i = 0; i < s.n; i++){
+		if (i == p) continue;
+		double x_diff = s.xy[2*p] - s.xy[2*i];
+		double y_diff = s.xy[2*p+1] - s.xy[2*i+1];
+		double dist = sqrt(x_diff * x_diff + y_diff * y_diff);
+		double dist_cubed = dist * dist * dist;
+		dxdx += k[i] * (1 - (l[i] * y_diff * y_diff)/dist_cubed);
+		dxdy += k[i] * l[i] * x_diff * y_diff / dist_cubed;
+		dydy += k[i] * (1 - (l[i] * x_diff * x_diff)/dist_cubed);
+	}
+#endif
+}
+
+// Relative change of the energy below KK_TOLERANCE, as layout_tolerance
+static bool converged(double& last, double delta, bool global){
+
+	if (last < 0){
+		last = delta;
+		return(!global && delta == 0);
+	}
+	double diff = last - delta;
+	if (global && diff < 0) diff = -diff;
+	bool done = (delta == 0 || diff / last < KK_TOLERANCE);
+	last = delta;
+	return(done);
+}
+
+bool graph_distances(unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, vector<double>& distance){
+
+	// Adjacency lists in one array
+	vector<unsigned int> first(vertices+1, 0), adjacent(2*edges.size());
+	for (unsigned int e = 0; e < edges.size(); e++){
+		first[edges[e].first+1]++;
+		first[edges[e].second+1]++;
+	}
+	for (unsigned int v = 0; v < vertices; v++) first[v+1] += first[v];
+	vector<unsigned int> fill(first.begin(), first.end()-1);
+	for (unsigned int e = 0; e < edges.size(); e++){
+		adjacent[fill[edges[e].first]++] = edges[e].second;
+		adjacent[fill[edges[e].second]++] = edges[e].first;
+	}
+
+	// Graph distance of h hops, added up one edge at a time as the
+	// shortest path search of the Boost version does
+	vector<double> hop_distance(vertices, 0.0);
+	for (unsigned int h = 1; h < vertices; h++) hop_distance[h] = hop_distance[h-1] + edge_weight;
+
+	distance.assign(vertices*vertices, 0.0);
+	vector<int> hops(vertices);
+	vector<unsigned int> queue(vertices);
+	for (unsigned int source = 0; source < vertices; source++){
+		hops.assign(vertices, -1);
+		hops[source] = 0;
+		unsigned int head = 0, tail = 0;
+		queue[tail++] = source;
+		while (head < tail){
+			unsigned int v = queue[head++];
+			for (unsigned int a = first[v]; a < first[v+1]; a++){
+				unsigned int w = adjacent[a];
+				if (hops[w] < 0){
+					hops[w] = hops[v] + 1;
+					queue[tail++] = w;
+				}
+			}
+		}
+		if (tail < vertices) return false;
+		for (unsigned int v = 0; v < vertices; v++) distance[source*vertices + v] = hop_distance[hops[v]];
+	}
+	return true;
+}
+
+// Spring lengths and strengths between every pair of vertices, false
+// if some pair isn't connected
+static bool build_springs(spring_system& s, unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, double edge_length, const double* x, const double* y){
+
+	s.n = vertices;
+	if (!graph_distances(vertices, edges, edge_weight, s.distance)) return false;
+	s.strength.assign(vertices*vertices, 0.0);
+	for (unsigned int i = 0; i < vertices*vertices; i++){
+		double d = s.distance[i];
+		if (d == 0) continue;
+		s.distance[i] = edge_length * d;
+		s.strength[i] = 1.0/(d*d);
+	}
+
+	s.xy.resize(2*vertices);
+	for (unsigned int v = 0; v < vertices; v++){
+		s.xy[2*v] = x[v];
+		s.xy[2*v+1] = y[v];
+	}
+	return true;
+}
+
+bool uniform_kamada_kawai_layout(unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, double edge_length, double* x, double* y, int max_iterations, int& iterations){
+
+	iterations = 0;
+	if (!vertices) return true;
+
+	spring_system s;
+	if (!build_springs(s, vertices, edges, edge_weight, edge_length, x, y)) return false;
+
+	vector<double> dE_dx(vertices), dE_dy(vertices);
+	vector<double> p_dx(vertices), p_dy(vertices);
+	unsigned int p = 0;
+	double delta_p = 0;
+	for (unsigned int v = 0; v < vertices; v++){
+		partials(s, v, dE_dx[v], dE_dy[v]);
+		double delta = sqrt(dE_dx[v]*dE_dx[v] + dE_dy[v]*dE_dy[v]);
+		if (delta > delta_p){
+			p = v;
+			delta_p = delta;
+		}
+	}
+
+	double last_energy = -1, last_local_energy = -1;
+	while (!converged(last_energy, delta_p, true)){
+
+		// Get out of here if we get stuck in this loop
+		if (iterations >= max_iterations) break;
+		iterations++;
+
+		for (unsigned int v = 0; v < vertices; v++) partial(s, v, p, p_dx[v], p_dy[v]);
+
+		// Newton-Raphson steps on p
+		do {
+			double dxdx, dxdy, dydy;
+			second_partials(s, p, dxdx, dxdy, dydy);
+			double dx = dE_dx[p], dy = dE_dy[p];
+			double delta_x = (dxdy * dy - dydy * dx) / (dxdx * dydy - dxdy * dxdy);
+			double delta_y = (dxdx * dy - dxdy * dx) / (dxdy * dxdy - dxdx * dydy);
+			s.xy[2*p] += delta_x;
+			s.xy[2*p+1] += delta_y;
+
+			partials(s, p, dE_dx[p], dE_dy[p]);
+			delta_p = sqrt(dE_dx[p]*dE_dx[p] + dE_dy[p]*dE_dy[p]);
+		} while (!converged(last_local_energy, delta_p, false));
+
+		// Only the springs to p changed, then take the vertex with the
+		// most energy next
+		unsigned int old_p = p;
+		for (unsigned int v = 0; v < vertices; v++){
+			double dx, dy;
+			partial(s, v, old_p, dx, dy);
+			dE_dx[v] += dx - p_dx[v];
+			dE_dy[v] += dy - p_dy[v];
+			double delta = sqrt(dE_dx[v]*dE_dx[v] + dE_dy[v]*dE_dy[v]);
+			if (delta > delta_p){
+				p = v;
+				delta_p = delta;
+			}
+		}
+	}
+
+	for (unsigned int v = 0; v < vertices; v++){
+		x[v] = s.xy[2*v];
+		y[v] = s.xy[2*v+1];
+	}
+	return true;
+}
+
+bool kamada_kawai_energy(unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, double edge_length, const double* x, const double* y, double& energy){
+
+	energy = 0;
+	spring_system s;
+	if (!build_springs(s, vertices, edges, edge_weight, edge_length, x, y)) return false;
+	for (unsigned int i = 0; i < vertices; i++){
+		for (unsigned int j = i+1; j < vertices; j++){
+			double x_diff = x[i] - x[j];
+			double y_diff = y[i] - y[j];
+			double stretch = sqrt(x_diff * x_diff + y_diff * y_diff) - s.distance[i*vertices + j];
+			energy += 0.5 * s.strength[i*vertices + j] * stretch * stretch;
+		}
+	}
+	return true;
+}
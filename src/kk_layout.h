@@ -0,0 +1,53 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Kamada-Kawai spring layout for graphs whose edges all
+// have the same weight, as the helix contact graphs of kk_plot do.
+// It takes the same steps as kamada_kawai_spring_layout.h, but finds
+// the graph distances by breadth first search, keeps the distance and
+// spring matrices and the positions in flat arrays and works out the x
+// and y terms of each spring together in SIMD lanes.
+//
+
+#ifndef KK_LAYOUT_H
+#define KK_LAYOUT_H
+
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+// Layout engines, smacof is in stress_layout.h
+enum {LAYOUT_KK, LAYOUT_FAST, LAYOUT_SMACOF};
+
+// Iteration cap of the Boost version
+#define KK_MAX_ITERATIONS 200000
+
+// Row major graph distances between every pair of vertices, each edge
+// being edge_weight long. False if the graph isn't connected.
+bool graph_distances(unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, vector<double>& distance);
+
+// Moves the vertices 0..vertices-1, starting from x and y, to the
+// Kamada-Kawai layout with edge_length per unit of graph distance,
+// each edge being edge_weight long. Stops after max_iterations moves
+// even if the layout hasn't converged; iterations is set to the number
+// made. Like the Boost version, returns false and leaves the positions
+// alone if the graph isn't connected.
+bool uniform_kamada_kawai_layout(unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, double edge_length, double* x, double* y, int max_iterations, int& iterations);
+
+// Spring energy of the layout x, y, the quantity Kamada-Kawai minimises.
+// False if the graph isn't connected.
+bool kamada_kawai_energy(unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, double edge_length, const double* x, const double* y, double& energy);
+
+#endif
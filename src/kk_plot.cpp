@@ -0,0 +1,230 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: kk_plot, the command line front end to the layout
+// library. Reads a _CONTACT_DEF results file and prints the ranked
+// helix arrangements of each component of its helix contact graph.
+//
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "draw_graphs.h"
+#include "mempack_layout.h"
+
+using namespace std;
+
+// Long options without a short form
+enum { OPT_POOL_SIZE = 256, OPT_MUTATION_RATE, OPT_CROSSOVER_RATE, OPT_MUTATION_DECAY, OPT_STALL, OPT_MIN_IMPROVEMENT,
+       OPT_MAX_EVALUATIONS, OPT_MAX_TIME, OPT_GA_RESTARTS, OPT_ADAPTIVE_MUTATION, OPT_GA_STATS, OPT_LAYOUT_STARTS,
+       OPT_LAYOUT_ITERATIONS, OPT_LAYOUT_TOLERANCE, OPT_TOP,
+       OPT_LAYOUT_CACHE };
+
+static void usage(){
+
+	cout << "Usage: kk_plot [options] <contact results file>" << endl << endl;
+	cout << "Options:" << endl << endl;
+	cout << "--layout=<kk|fast|smacof> Helix layout engine. Default fast." << endl;
+	cout << "                     kk = Kamada-Kawai spring layout of the Boost graph library" << endl;
+	cout << "                     fast = the same layout specialised for equal edge weights" << endl;
+	cout << "                     smacof = stress majorisation of the same spring energy" << endl;
+	cout << "--layout-tolerance=<float> Relative fall in energy below which the smacof" << endl;
+	cout << "                     layout stops. Default 0.0001." << endl;
+	cout << "--layout-starts=<int> Layouts to run at once, from the usual starting positions" << endl;
+	cout << "                     and from random ones, keeping the one with the lowest" << endl;
+	cout << "                     spring energy. Default 1." << endl;
+	cout << "--layout-iterations=<int> Moves each layout may make before it gives up." << endl;
+	cout << "                     Default " << KK_MAX_ITERATIONS << "." << endl;
+	cout << "--layout-cache=<file> Keep layouts for other proteins whose helix contact" << endl;
+	cout << "                     graphs have the same shape, and the alternate" << endl;
+	cout << "                     arrangements of each." << endl;
+	cout << "--optimiser=<ga|cd|dp> Helix rotation optimiser. Default ga." << endl;
+	cout << "                     ga = genetic algorithm (paramopt)" << endl;
+	cout << "                     cd = coordinate descent with an exact 360 degree scan per helix" << endl;
+	cout << "                     dp = exact optimum over rotation bins by dynamic programming" << endl;
+	cout << "--restarts=<int>     Random restarts for the cd optimiser. Default 10." << endl;
+	cout << "--bins=<int>         Rotation bins per helix for the dp optimiser. Default 36." << endl;
+	cout << "--max-width=<int>    Largest tree width the dp optimiser accepts before falling" << endl;
+	cout << "                     back to cd. Default 3." << endl;
+	cout << "--threads=<int>      Threads for optimising the arrangements at once and" << endl;
+	cout << "                     scoring each ga generation. Default all cores." << endl;
+	cout << "--ga-eval=<incremental|batch> How the ga scores a generation. Default incremental." << endl;
+	cout << "                     incremental = one at a time, only contacts of changed helices" << endl;
+	cout << "                     batch = " << ROTATION_LANES << " at a time across SIMD lanes, every contact" << endl;
+	cout << "--warm-start         Start the rotation search of each swapped arrangement" << endl;
+	cout << "                     from the best rotations of the original layout." << endl;
+	cout << "--rotation-cache=<file> Start from, and keep, the best rotations of earlier runs." << endl;
+	cout << "--top=<int>          Keep only this many of the best arrangements of each" << endl;
+	cout << "                     component, releasing the others as they finish." << endl;
+	cout << "                     Default 0, all of them." << endl;
+	cout << "--pool-size=<int>    Ga population size. Default 50." << endl;
+	cout << "--mutation-rate=<float> Chance of mutating each rotation. Default 0.1." << endl;
+	cout << "--crossover-rate=<float> Chance of crossing over each pair. Default 0.8." << endl;
+	cout << "--mutation-decay=<float> Mutation step scale factor per generation. Default 1." << endl;
+	cout << "--stall=<int>        Generations without progress before the ga stops. Default 50." << endl;
+	cout << "--min-improvement=<float> Relative improvement of the best score that counts" << endl;
+	cout << "                     as progress. Default 0, any improvement." << endl;
+	cout << "--max-evaluations=<int> Stop each ga after this many evaluations. Default no limit." << endl;
+	cout << "--max-time=<float>   Stop each ga after this many seconds. Default no limit." << endl;
+	cout << "--ga-restarts=<int>  Restarts from the best member when the ga stalls. Default 0." << endl;
+	cout << "--adaptive-mutation  Shrink the mutation step while the ga improves and" << endl;
+	cout << "                     grow it while it stalls." << endl;
+	cout << "--ga-stats           Report generations, evaluations and improvement of each ga." << endl;
+	cout << "--seed=<int>         Random seed, so that a run can be repeated exactly." << endl;
+	cout << "                     Default: from the time, host and process id." << endl;
+	cout << "--verbose            Report the helix swaps and loop crossovers." << endl;
+	cout << "--help               Show help." << endl << endl;
+	exit(1);
+}
+
+int main(int argc, char* argv[]){
+
+	static struct option long_options[] = {
+		{"layout", required_argument, 0, 'l'},
+		{"layout-starts", required_argument, 0, OPT_LAYOUT_STARTS},
+		{"layout-iterations", required_argument, 0, OPT_LAYOUT_ITERATIONS},
+		{"layout-tolerance", required_argument, 0, OPT_LAYOUT_TOLERANCE},
+		{"layout-cache", required_argument, 0, OPT_LAYOUT_CACHE},
+		{"optimiser", required_argument, 0, 'o'},
+		{"restarts", required_argument, 0, 'r'},
+		{"bins", required_argument, 0, 'b'},
+		{"max-width", required_argument, 0, 'w'},
+		{"threads", required_argument, 0, 't'},
+		{"seed", required_argument, 0, 's'},
+		{"ga-eval", required_argument, 0, 'e'},
+		{"warm-start", no_argument, 0, 'W'},
+		{"rotation-cache", required_argument, 0, 'C'},
+		{"top", required_argument, 0, OPT_TOP},
+		{"pool-size", required_argument, 0, OPT_POOL_SIZE},
+		{"mutation-rate", required_argument, 0, OPT_MUTATION_RATE},
+		{"crossover-rate", required_argument, 0, OPT_CROSSOVER_RATE},
+		{"mutation-decay", required_argument, 0, OPT_MUTATION_DECAY},
+		{"stall", required_argument, 0, OPT_STALL},
+		{"min-improvement", required_argument, 0, OPT_MIN_IMPROVEMENT},
+		{"max-evaluations", required_argument, 0, OPT_MAX_EVALUATIONS},
+		{"max-time", required_argument, 0, OPT_MAX_TIME},
+		{"ga-restarts", required_argument, 0, OPT_GA_RESTARTS},
+		{"adaptive-mutation", no_argument, 0, OPT_ADAPTIVE_MUTATION},
+		{"ga-stats", no_argument, 0, OPT_GA_STATS},
+		{"verbose", no_argument, 0, 'v'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+	layout_options options;
+	bool seeded = false;
+	int opt;
+	while ((opt = getopt_long(argc, argv, "l:o:r:b:w:t:s:e:WC:vh", long_options, NULL)) != -1){
+		switch (opt){
+			case 'l':
+				if (!strcmp(optarg, "kk")){
+					options.engine = LAYOUT_KK;
+				}else if (!strcmp(optarg, "fast")){
+					options.engine = LAYOUT_FAST;
+				}else if (!strcmp(optarg, "smacof")){
+					options.engine = LAYOUT_SMACOF;
+				}else{
+					cout << "Unknown layout " << optarg << endl;
+					exit(1);
+				}
+				break;
+			case OPT_LAYOUT_STARTS: options.starts = max(atoi(optarg), 1); break;
+			case OPT_LAYOUT_ITERATIONS: options.iterations = atoi(optarg); break;
+			case OPT_LAYOUT_TOLERANCE: options.tolerance = atof(optarg); break;
+			case OPT_TOP: options.top = max(atoi(optarg), 0); break;
+			case OPT_LAYOUT_CACHE: options.layout_cache = optarg; break;
+			case 'o':
+				if (!strcmp(optarg, "ga")){
+					options.optimiser = OPTIMISER_GA;
+				}else if (!strcmp(optarg, "cd")){
+					options.optimiser = OPTIMISER_CD;
+				}else if (!strcmp(optarg, "dp")){
+					options.optimiser = OPTIMISER_DP;
+				}else{
+					cout << "Unknown optimiser " << optarg << endl;
+					exit(1);
+				}
+				break;
+			case 'r': options.cd_restarts = atoi(optarg); break;
+			case 'b': options.dp_bins = atoi(optarg); break;
+			case 'w': options.dp_max_width = atoi(optarg); break;
+			case 't': options.threads = atoi(optarg); break;
+			case 'e':
+				if (!strcmp(optarg, "incremental")){
+					options.ga_eval = GA_EVAL_INCREMENTAL;
+				}else if (!strcmp(optarg, "batch")){
+					options.ga_eval = GA_EVAL_BATCH;
+				}else{
+					cout << "Unknown ga evaluation " << optarg << endl;
+					exit(1);
+				}
+				break;
+			case 'W': options.warm_start = true; break;
+			case OPT_POOL_SIZE: options.ga.poolsize = atoi(optarg); break;
+			case OPT_MUTATION_RATE: options.ga.mutrate = atof(optarg); break;
+			case OPT_CROSSOVER_RATE: options.ga.crosrate = atof(optarg); break;
+			case OPT_MUTATION_DECAY: options.ga.mutscfac = atof(optarg); break;
+			case OPT_STALL: options.ga.stall = atoi(optarg); break;
+			case OPT_MIN_IMPROVEMENT: options.ga.min_improvement = atof(optarg); break;
+			case OPT_MAX_EVALUATIONS: options.ga.max_evals = atoi(optarg); break;
+			case OPT_MAX_TIME: options.ga.max_time = atof(optarg); break;
+			case OPT_GA_RESTARTS: options.ga.restarts = atoi(optarg); break;
+			case OPT_ADAPTIVE_MUTATION: options.ga.adaptive = 1; break;
+			case OPT_GA_STATS: options.ga.stats = 1; break;
+			case 'C': options.rotation_cache = optarg; break;
+			case 's': options.seed = strtoull(optarg, NULL, 10); seeded = true; break;
+			case 'v': options.verbose = true; break;
+			default: usage();
+		}
+	}
+
+	if (!seeded){
+		cout << "Random seed " << options.seed << ", use --seed=" << options.seed << " to repeat this run." << endl;
+	}
+
+       // Exit unless filename given as argument
+        if (optind >= argc){
+                cout << "File containing graph data is required." << endl;
+		exit(1);
+        }
+	
+       	ifstream is(argv[optind]);
+
+        // Check to make sure the stream is ok
+        if(!is.good()){
+                cout << "Cannot open file "<< argv[optind] << endl;
+                exit(1);
+	}else{
+		cout << "Reading input file " << argv[optind] << "..." << endl;
+	}
+
+	vector<int> helix_boundaries;
+	vector<layout_contact> residue_contacts;
+	read_layout_input(is, helix_boundaries, residue_contacts);
+	is.close();
+
+	layout_result result;
+	string error;
+	if (!mempack_layout(helix_boundaries, residue_contacts, options, result, cout, error)){
+		cout << error << endl;
+		exit(1);
+	}
+	write_layout_result(cout, result);
+	save_layout_caches(cout);
+
+  	return 1;
+}
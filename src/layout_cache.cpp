@@ -0,0 +1,256 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Cache of helix layouts shared between proteins. The
+// canonical labelling refines the vertices by their neighbours until
+// they can't be told apart any further, then tries each vertex of the
+// first cell that is left in turn, keeping the numbering that gives the
+// smallest adjacency matrix. Both steps depend only on the graph, not
+// its numbering.
+//
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <mutex>
+#include <stdio.h>
+#include "layout_cache.h"
+#include "rotation_cache.h"
+
+using namespace std;
+
+typedef vector<unsigned long long> adjacency;
+
+// Leaves of the search before canonical_labelling gives up
+#define CANONICAL_MAX_LEAVES 20000
+
+// Renumbers colours 0.. in the order of their values
+static int compact(vector<int>& colour){
+
+	vector<int> values(colour);
+	sort(values.begin(), values.end());
+	values.erase(unique(values.begin(), values.end()), values.end());
+	for (unsigned int v = 0; v < colour.size(); v++){
+		colour[v] = lower_bound(values.begin(), values.end(), colour[v]) - values.begin();
+	}
+	return(values.size());
+}
+
+// Splits cells of colour until every vertex of a cell has the same
+// number of neighbours in each cell. A new cell is placed by its old
+// colour and then by those counts, never by vertex number.
+static void refine(const adjacency& adj, vector<int>& colour){
+
+	unsigned int n = colour.size();
+	int cells = compact(colour);
+	while (true){
+		vector<pair<vector<int>,int> > signature(n);
+		for (unsigned int v = 0; v < n; v++){
+			vector<int>& s = signature[v].first;
+			s.assign(cells+1, 0);
+			s[0] = colour[v];
+			for (unsigned int w = 0; w < n; w++){
+				if (adj[v] >> w & 1) s[colour[w]+1]++;
+			}
+			signature[v].second = v;
+		}
+		sort(signature.begin(), signature.end());
+		int split = 0;
+		for (unsigned int i = 0; i < n; i++){
+			if (i && signature[i].first != signature[i-1].first) split++;
+			colour[signature[i].second] = split;
+		}
+		if (split+1 == cells) return;
+		cells = split+1;
+	}
+}
+
+struct canonical_search {
+	adjacency adj;
+	adjacency best;
+	vector<int> canon;
+	long leaves;
+};
+
+static void search(canonical_search& s, vector<int> colour){
+
+	unsigned int n = colour.size();
+	refine(s.adj, colour);
+
+	vector<int> size(n, 0);
+	for (unsigned int v = 0; v < n; v++) size[colour[v]]++;
+	int cell = -1;
+	for (unsigned int c = 0; c < n && cell < 0; c++){
+		if (size[c] > 1) cell = c;
+	}
+
+	// Every vertex told apart, the matrix in this order
+	if (cell < 0){
+		adjacency matrix(n, 0);
+		for (unsigned int v = 0; v < n; v++){
+			for (unsigned int w = 0; w < n; w++){
+				if (s.adj[v] >> w & 1) matrix[colour[v]] |= 1ULL << colour[w];
+			}
+		}
+		if (s.canon.empty() || matrix < s.best){
+			s.best = matrix;
+			s.canon = colour;
+		}
+		s.leaves++;
+		return;
+	}
+
+	// Two vertices with the same neighbours can be swapped without
+	// changing the graph, so only one of them needs trying
+	vector<int> tried;
+	for (unsigned int v = 0; v < n; v++){
+		if (colour[v] != cell) continue;
+		if (s.leaves >= CANONICAL_MAX_LEAVES) return;
+		bool twin = false;
+		for (unsigned int t = 0; t < tried.size() && !twin; t++){
+			unsigned long long u_bit = 1ULL << tried[t], v_bit = 1ULL << v;
+			twin = (s.adj[tried[t]] & ~v_bit) == (s.adj[v] & ~u_bit);
+		}
+		if (twin) continue;
+
+		// v goes first in its cell
+		vector<int> individual(n);
+		for (unsigned int w = 0; w < n; w++) individual[w] = 2*colour[w] + (colour[w] == cell && w != v);
+		search(s, individual);
+		tried.push_back(v);
+	}
+}
+
+bool canonical_labelling(unsigned int vertices, const vector<pair<int,int> >& edges, vector<int>& canon, string& key){
+
+	if (vertices == 0 || vertices > CANONICAL_MAX_VERTICES) return false;
+
+	canonical_search s;
+	s.adj.assign(vertices, 0);
+	s.leaves = 0;
+	for (unsigned int e = 0; e < edges.size(); e++){
+		s.adj[edges[e].first] |= 1ULL << edges[e].second;
+		s.adj[edges[e].second] |= 1ULL << edges[e].first;
+	}
+	search(s, vector<int>(vertices, 0));
+	if (s.leaves >= CANONICAL_MAX_LEAVES) return false;
+
+	canon = s.canon;
+	ostringstream text;
+	text << vertices;
+	char row[17];
+	for (unsigned int v = 0; v < vertices; v++){
+		sprintf(row, "%llx", s.best[v]);
+		text << " " << row;
+	}
+	key = text.str();
+	return true;
+}
+
+void load_layout_cache(const string& file, layout_cache& cache){
+
+	ifstream is(file.c_str());
+	string line;
+	while (getline(is, line)){
+		istringstream fields(line);
+		string key;
+		double value;
+		vector<double> values;
+		if (!(fields >> key)) continue;
+		while (fields >> value) values.push_back(value);
+		if (!values.empty()) cache[key] = values;
+	}
+}
+
+bool save_layout_cache(const string& file, const layout_cache& cache){
+
+	ostringstream os;
+	os.precision(17);
+	for (layout_cache::const_iterator it = cache.begin(); it != cache.end(); it++){
+		os << it->first;
+		for (unsigned int i = 0; i < it->second.size(); i++) os << " " << it->second[i];
+		os << "\n";
+	}
+	return(replace_file(file, os.str()));
+}
+
+// Entries of each file as read on its first use or last flush, and
+// the entries added since
+struct layout_files {
+	mutex m;
+	map<string,layout_cache> entries, added;
+};
+
+static layout_files& layout_store(){
+
+	static layout_files store;
+	return store;
+}
+
+// With the store locked
+static layout_cache& loaded(layout_files& store, const string& file){
+
+	map<string,layout_cache>::iterator it = store.entries.find(file);
+	if (it == store.entries.end()){
+		it = store.entries.insert(make_pair(file, layout_cache())).first;
+		load_layout_cache(file, it->second);
+	}
+	return(it->second);
+}
+
+bool cached_layout(const string& file, const string& key, vector<double>& values){
+
+	layout_files& store = layout_store();
+	lock_guard<mutex> lock(store.m);
+	layout_cache& cache = loaded(store, file);
+	layout_cache::const_iterator hit = cache.find(key);
+	if (hit == cache.end()) return false;
+	values = hit->second;
+	return true;
+}
+
+void cache_layout(const string& file, const string& key, const vector<double>& values){
+
+	layout_files& store = layout_store();
+	lock_guard<mutex> lock(store.m);
+	loaded(store, file)[key] = values;
+	store.added[file][key] = values;
+}
+
+bool flush_layout_caches(vector<string>& failed){
+
+	layout_files& store = layout_store();
+	lock_guard<mutex> lock(store.m);
+	bool ok = true;
+	map<string,layout_cache>::iterator it = store.added.begin();
+	while (it != store.added.end()){
+		int fd = lock_cache_file(it->first);
+		layout_cache merged;
+		load_layout_cache(it->first, merged);
+		for (layout_cache::const_iterator entry = it->second.begin(); entry != it->second.end(); entry++){
+			merged[entry->first] = entry->second;
+		}
+		bool saved = fd != -1 && save_layout_cache(it->first, merged);
+		if (fd != -1) unlock_cache_file(fd);
+		if (!saved){
+			failed.push_back(it->first);
+			ok = false;
+			it++;
+			continue;
+		}
+		store.entries[it->first].swap(merged);
+		store.added.erase(it++);
+	}
+	return(ok);
+}
@@ -0,0 +1,59 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Cache of helix layouts shared between proteins. Many
+// proteins have the same helix contact graph up to the numbering of
+// the helices, so layouts are keyed by a canonical labelling of the
+// graph and kept in that order. The alternative arrangements found
+// by swapping helices depend on the loops between helices that follow
+// each other in sequence, so they are keyed by the graph in sequence
+// order and the layout it started from.
+//
+
+#ifndef LAYOUT_CACHE_H
+#define LAYOUT_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+typedef map<string,vector<double> > layout_cache;
+
+// Largest graph that is labelled
+#define CANONICAL_MAX_VERTICES 64
+
+// Numbers the vertices 0..vertices-1 of a graph so that graphs that
+// differ only in their numbering get the same adjacency matrix:
+// vertex v becomes canon[v] and key holds the matrix in the new order.
+// False for graphs over CANONICAL_MAX_VERTICES, and for graphs so
+// symmetric that the search gives up.
+bool canonical_labelling(unsigned int vertices, const vector<pair<int,int> >& edges, vector<int>& canon, string& key);
+
+// A missing file is an empty cache
+void load_layout_cache(const string& file, layout_cache& cache);
+
+// As save_rotation_cache. Values are written to full precision, so a
+// layout read back is the one that was stored.
+bool save_layout_cache(const string& file, const layout_cache& cache);
+
+// The layout caches of the process, by file, shared and written as
+// the rotation caches are
+bool cached_layout(const string& file, const string& key, vector<double>& values);
+void cache_layout(const string& file, const string& key, const vector<double>& values);
+bool flush_layout_caches(vector<string>& failed);
+
+#endif
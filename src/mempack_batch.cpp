@@ -0,0 +1,643 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Batch driver for proteome scale runs. Reads a
+// manifest of .mtx or fasta files and topologies, runs PSI-BLAST
+// for the fasta files, loads the SVM models once
+// and predicts lipid exposure and residue contacts for every protein,
+// writing the same results files as run_mempack.pl. Layouts are
+// generated with the layout library, as kk_plot would, and optionally
+// drawn by run_mempack.pl.
+// Every stage of every protein is a task for the stage scheduler, so
+// the layout of one protein runs while the contacts of the next are
+// still being classified.
+//
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "features.h"
+#include "profiles.h"
+#include "scheduler.h"
+#include "mempack_layout.h"
+
+using namespace std;
+
+struct batch_entry {
+	string fasta;
+	string mtx;
+	string header;
+	vector<int> topology;
+	long pairs;
+};
+
+// Residue pairs are classified in chunks of about this many, so the
+// pairs of one large protein can be spread over all workers
+static const long chunk_pairs = 4096;
+
+static MODEL* lipid_model = NULL;
+static MODEL* contact_model = NULL;
+static string output_path = "output/";
+static string mem_dir = "";
+static string render_script = "run_mempack.pl";
+static string layout_cache_file = "";
+static int def = 1;
+static bool layout = true;
+static bool render = false;
+static search_config psiblast;
+static unsigned int search_cores = 1;
+static atomic<long> profiles_cached(0);
+
+static mutex report_m;
+static atomic<long> proteins_done(0), proteins_failed(0);
+
+static void report(const string& message){
+
+	lock_guard<mutex> lock(report_m);
+	cout << message << endl;
+}
+
+static double wall_time(){
+
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return(tv.tv_sec + tv.tv_usec/1e6);
+}
+
+static void tokenize(const string& str, vector<int>& tokens){
+
+	istringstream is(str);
+	string token;
+	while (getline(is, token, ',')){
+		if (!token.empty()) tokens.push_back(atoi(token.c_str()));
+	}
+}
+
+static bool ends_with(const string& str, const string& suffix){
+
+	return(str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+static bool is_fasta(const string& file){
+
+	return(ends_with(file, ".fasta") || ends_with(file, ".fa"));
+}
+
+// Results file names follow run_mempack.pl: the .mtx or fasta name
+// without directory or extension
+static string get_header(const string& file){
+
+	string header = file;
+	string::size_type slash = header.find_last_of('/');
+	if (slash != string::npos) header = header.substr(slash+1);
+	string::size_type ext = header.rfind(".lmtx");
+	if (ext == string::npos) ext = header.rfind(".mtx");
+	if (ext == string::npos && is_fasta(header)) ext = header.rfind(".fa");
+	if (ext != string::npos) header = header.substr(0, ext);
+	return(header);
+}
+
+static bool read_manifest(const char* file, vector<batch_entry>& entries){
+
+	ifstream is(file);
+	if (!is.good()) return false;
+
+	string line;
+	int line_no = 0;
+	while (getline(is, line)){
+		line_no++;
+		istringstream fields(line);
+		batch_entry entry;
+		string topology;
+		if (!(fields >> entry.mtx) || entry.mtx[0] == '#') continue;
+		if (!(fields >> topology)){
+			cerr << "Manifest line " << line_no << " has no topology, skipping." << endl;
+			continue;
+		}
+		tokenize(topology, entry.topology);
+		if (entry.topology.empty() || entry.topology.size() % 2){
+			cerr << "Manifest line " << line_no << ": uneven number of helix boundaries, skipping." << endl;
+			continue;
+		}
+		entry.header = get_header(entry.mtx);
+
+		// Profiles for fasta files are written next to the results,
+		// where run_mempack.pl puts them
+		if (is_fasta(entry.mtx)){
+			entry.fasta = entry.mtx;
+			entry.mtx = output_path + entry.header + ".mtx";
+		}
+
+		// Number of residue pairs between helices, used to start the
+		// largest proteins first
+		entry.pairs = 0;
+		long residues = 0;
+		for (unsigned int h = 0; h < entry.topology.size(); h += 2){
+			long len = entry.topology[h+1] - entry.topology[h] + 1;
+			entry.pairs += residues * len;
+			residues += len;
+		}
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+// One row of the contact input: residue p1 against every residue of
+// every later helix
+struct contact_row {
+	int h;
+	int p1;
+	int helix_pos;
+	long pairs;
+};
+
+// State shared by the stages of one protein
+struct protein_job {
+	batch_entry entry;
+	profile_t profile;
+	vector<double> lipid;
+	vector<contact_row> rows;
+	vector<unsigned int> chunk_start;
+	vector<string> chunk_results;
+	string contact_file;
+	bool contacts;
+	double start;
+};
+
+// Split the residue pairs into chunks of whole rows. Only the
+// topology is needed, so the contact tasks can be set up before the
+// profile is loaded.
+static void split_rows(protein_job& job){
+
+	const vector<int>& topology = job.entry.topology;
+	long pairs = 0;
+	long residues_after = 0;
+	for (unsigned int h = 0; h < topology.size(); h += 2){
+		residues_after += topology[h+1] - topology[h] + 1;
+	}
+	for (unsigned int h = 0; h < topology.size(); h += 2){
+		residues_after -= topology[h+1] - topology[h] + 1;
+		int helix_pos = 1;
+		for (int p1 = topology[h]; p1 <= topology[h+1]; p1++, helix_pos++){
+			contact_row row;
+			row.h = h;
+			row.p1 = p1;
+			row.helix_pos = helix_pos;
+			row.pairs = residues_after;
+			if (job.rows.empty() || pairs >= chunk_pairs){
+				job.chunk_start.push_back(job.rows.size());
+				pairs = 0;
+			}
+			job.rows.push_back(row);
+			pairs += row.pairs;
+		}
+	}
+	job.chunk_results.assign(job.chunk_start.size(), string());
+}
+
+// Profile search for fasta entries. An existing .mtx is reused like
+// run_mempack.pl does, extra granted cores go to blastpgp.
+static bool profile_stage(protein_job& job, unsigned int cores){
+
+	const batch_entry& entry = job.entry;
+	job.start = wall_time();
+	if (!access(entry.mtx.c_str(), R_OK)){
+		report(entry.mtx + " exists!");
+		return true;
+	}
+
+	bool cached;
+	string message;
+	if (!make_profile(psiblast, entry.fasta, entry.mtx, cores, cached, message)){
+		report(message);
+		return false;
+	}
+	if (cached){
+		profiles_cached++;
+		report("Written " + entry.mtx + " (cached)");
+	}else{
+		report("Written " + entry.mtx);
+	}
+	return true;
+}
+
+// Load the profile and predict lipid exposure
+static bool lipid_stage(protein_job& job){
+
+	const batch_entry& entry = job.entry;
+	const vector<int>& topology = entry.topology;
+	if (entry.fasta.empty()) job.start = wall_time();
+
+	if (!load_profile(entry.mtx, job.profile)){
+		report("Couldn't load " + entry.mtx + ", skipping.");
+		return false;
+	}
+	if (topology.back() > job.profile.length){
+		report("Topology of " + entry.header + " extends past the end of the sequence, skipping.");
+		return false;
+	}
+
+	string lipid_out = output_path + entry.header + "_LIPID_EXPOSURE.results";
+	ofstream out(lipid_out.c_str());
+	if (!out.good()){
+		report("Couldn't write to " + lipid_out);
+		return false;
+	}
+	out << "Pos\tRes\tScore\n";
+	job.lipid.assign(job.profile.length + 2, 0);
+	vector<WORD> words;
+	for (unsigned int h = 0; h < topology.size(); h += 2){
+		for (int p1 = topology[h]; p1 <= topology[h+1]; p1++){
+			lipid_features(job.profile, p1, words);
+			string value = format_score(classify_words(lipid_model, words));
+			job.lipid[p1] = strtod(value.c_str(), NULL);
+			out << p1 << "\t" << window_residue(job.profile, p1) << "\t" << value << "\n";
+		}
+	}
+	out.close();
+	report("Written " + lipid_out);
+	return true;
+}
+
+static void classify_chunk(protein_job& job, unsigned int c){
+
+	const vector<int>& topology = job.entry.topology;
+	unsigned int row_end = c+1 < job.chunk_start.size() ? job.chunk_start[c+1] : job.rows.size();
+	vector<WORD> words;
+	ostringstream out;
+
+	for (unsigned int r = job.chunk_start[c]; r < row_end; r++){
+		const contact_row& row = job.rows[r];
+		contact_residue r1;
+		r1.pos = row.p1;
+		r1.helix = row.h/2 + 1;
+		r1.helix_pos = row.helix_pos;
+		r1.helix_length = topology[row.h+1] - topology[row.h] + 1;
+		r1.lipid = job.lipid[row.p1];
+
+		for (unsigned int nh = row.h+2; nh < topology.size(); nh += 2){
+			contact_residue r2;
+			r2.helix = nh/2 + 1;
+			r2.helix_length = topology[nh+1] - topology[nh] + 1;
+			r2.helix_pos = 1;
+			for (int p2 = topology[nh]; p2 <= topology[nh+1]; p2++, r2.helix_pos++){
+				r2.pos = p2;
+				r2.lipid = job.lipid[p2];
+				contact_features(job.profile, r1, r2, words);
+				string value = format_score(classify_words(contact_model, words));
+				if (strtod(value.c_str(), NULL) > 0){
+					out << row.p1 << "-" << p2 << "\t" << r1.helix << "-" << r2.helix << "\t" << value << "\n";
+				}
+			}
+		}
+	}
+	job.chunk_results[c] = out.str();
+}
+
+// Join the chunks into the contact results file, after which the
+// profile is no longer needed
+static bool contact_results_stage(protein_job& job){
+
+	const batch_entry& entry = job.entry;
+	ofstream out(job.contact_file.c_str());
+	if (!out.good()){
+		report("Couldn't write to " + job.contact_file);
+		return false;
+	}
+	out << "# Topology:\t";
+	for (unsigned int t = 0; t < entry.topology.size(); t++){
+		out << entry.topology[t] << (t+1 < entry.topology.size() ? "," : "\n");
+	}
+	job.contacts = false;
+	for (unsigned int c = 0; c < job.chunk_results.size(); c++){
+		out << job.chunk_results[c];
+		if (!job.chunk_results[c].empty()) job.contacts = true;
+	}
+	out.close();
+	report("Written " + job.contact_file);
+
+	job.chunk_results = vector<string>();
+	job.rows = vector<contact_row>();
+	job.lipid = vector<double>();
+	job.profile = profile_t();
+	return true;
+}
+
+static bool layout_stage(protein_job& job, unsigned int cores){
+
+	const batch_entry& entry = job.entry;
+	if (!job.contacts){
+		report("No predicted contacts for " + entry.header);
+		return true;
+	}
+	string graph_out = output_path + entry.header + "_graph.out";
+	ifstream is(job.contact_file.c_str());
+	vector<int> boundaries;
+	vector<layout_contact> contacts;
+	if (!read_layout_input(is, boundaries, contacts)){
+		report("Couldn't plot layout for " + entry.header);
+		return false;
+	}
+	is.close();
+
+	// The graph file reads as kk_plot's output would
+	ofstream os(graph_out.c_str());
+	layout_options options;
+	options.threads = cores;
+	options.layout_cache = layout_cache_file;
+	os << "Random seed " << options.seed << ", use --seed=" << options.seed << " to repeat this run." << endl;
+	layout_result result;
+	string error;
+	if (!mempack_layout(boundaries, contacts, options, result, os, error)){
+		os << error << endl;
+		report("Couldn't plot layout for " + entry.header + ": " + error);
+		return false;
+	}
+	write_layout_result(os, result);
+	if (!os.good()){
+		report("Couldn't plot layout for " + entry.header);
+		return false;
+	}
+	return true;
+}
+
+// Images are drawn by run_mempack.pl from the files written so far
+static bool render_stage(protein_job& job){
+
+	const batch_entry& entry = job.entry;
+	if (!job.contacts) return true;
+
+	ostringstream command;
+	command << "perl " << render_script << " -mtx 1 -render 1 -a " << def << " -t ";
+	for (unsigned int t = 0; t < entry.topology.size(); t++){
+		command << entry.topology[t] << (t+1 < entry.topology.size() ? "," : "");
+	}
+	command << " -j " << output_path;
+	if (!mem_dir.empty()) command << " -w " << mem_dir;
+	command << " " << entry.mtx << " > /dev/null";
+	if (system(command.str().c_str())){
+		report("Couldn't draw " + entry.header);
+		return false;
+	}
+	return true;
+}
+
+static void protein_done(protein_job& job){
+
+	proteins_done++;
+	ostringstream done;
+	done << "Finished " << job.entry.header << " (" << job.entry.pairs << " residue pairs) in " << wall_time() - job.start << " s";
+	report(done.str());
+}
+
+// Stages of one protein:
+//   [profile] -> lipid -> contact chunks -> contact results -> layout -> render
+// Later stages get a higher priority so proteins already in flight
+// are finished, and their memory released, before new ones start.
+// Within a stage the largest proteins go first.
+static void add_protein(stage_scheduler& scheduler, const batch_entry& entry){
+
+	shared_ptr<protein_job> job(new protein_job);
+	job->entry = entry;
+	job->contacts = false;
+	job->start = wall_time();
+	ostringstream def_name;
+	def_name << "_CONTACT_DEF" << def << ".results";
+	job->contact_file = output_path + entry.header + def_name.str();
+	split_rows(*job);
+
+	const double stage_rank = 1e15;
+	string id = entry.header + ":" + entry.mtx;
+
+	stage_task lipid;
+	if (!entry.fasta.empty()){
+		stage_task profile;
+		profile.name = entry.header + " profile";
+		profile.stage = "profile";
+		profile.outputs.push_back(id + ":profile");
+		profile.priority = entry.pairs;
+		profile.cores = search_cores;
+
+		// Lane 0 runs the search, the other lanes only hold their cores
+		// for blastpgp's threads
+		profile.run = [job](unsigned int lane, unsigned int lanes){ return lane ? true : profile_stage(*job, lanes); };
+		scheduler.add(profile);
+		lipid.inputs.push_back(id + ":profile");
+	}
+
+	lipid.name = entry.header + " lipid";
+	lipid.stage = "lipid";
+	lipid.outputs.push_back(id + ":lipid");
+	lipid.priority = stage_rank + entry.pairs;
+	lipid.cores = 1;
+	lipid.run = [job](unsigned int, unsigned int){ return lipid_stage(*job); };
+	scheduler.add(lipid);
+
+	stage_task results;
+	results.name = entry.header + " contact results";
+	results.stage = "results";
+	for (unsigned int c = 0; c < job->chunk_start.size(); c++){
+		ostringstream chunk_id;
+		chunk_id << id << ":chunk" << c;
+
+		stage_task chunk;
+		chunk.name = entry.header + " contacts " + chunk_id.str().substr(id.size()+1);
+		chunk.stage = "contact";
+		chunk.inputs.push_back(id + ":lipid");
+		chunk.outputs.push_back(chunk_id.str());
+		chunk.priority = 2*stage_rank + entry.pairs;
+		chunk.cores = 1;
+		chunk.run = [job, c](unsigned int, unsigned int){ classify_chunk(*job, c); return true; };
+		scheduler.add(chunk);
+		results.inputs.push_back(chunk_id.str());
+	}
+	results.outputs.push_back(id + ":contacts");
+	results.priority = 3*stage_rank + entry.pairs;
+	results.cores = 1;
+	results.run = [job](unsigned int, unsigned int){
+		if (!contact_results_stage(*job)) return false;
+		if (!layout && !render) protein_done(*job);
+		return true;
+	};
+	scheduler.add(results);
+	if (!layout) return;
+
+	stage_task plot;
+	plot.name = entry.header + " layout";
+	plot.stage = "layout";
+	plot.inputs.push_back(id + ":contacts");
+	plot.outputs.push_back(id + ":layout");
+	plot.priority = 4*stage_rank + entry.pairs;
+	plot.cores = 1;
+
+	// Layouts keep their state to themselves, so the layouts of several
+	// proteins run side by side, each on the one core of its task
+	plot.run = [job](unsigned int, unsigned int lanes){
+		if (!layout_stage(*job, lanes)) return false;
+		if (!render) protein_done(*job);
+		return true;
+	};
+	scheduler.add(plot);
+	if (!render) return;
+
+	stage_task draw;
+	draw.name = entry.header + " render";
+	draw.stage = "render";
+	draw.inputs.push_back(id + ":layout");
+	draw.priority = 5*stage_rank + entry.pairs;
+	draw.cores = 1;
+	draw.run = [job](unsigned int, unsigned int){
+		if (!render_stage(*job)) return false;
+		protein_done(*job);
+		return true;
+	};
+	scheduler.add(draw);
+}
+
+static void usage(){
+
+	cout << "Usage: mempack_batch [options] <manifest>" << endl << endl;
+	cout << "Each manifest line holds a PSI-BLAST .mtx file, or a .fasta/.fa file to run" << endl;
+	cout << "PSI-BLAST on, and its topology:" << endl << endl;
+	cout << "examples/2BRD_A.mtx 22,43,57,75,93,110,121,140,145,166,187,209,214,235" << endl << endl;
+	cout << "Options:" << endl << endl;
+	cout << "-a <1|2|3>     Contact definition (model CONTACT_ALL_DEF<n>). Default 1." << endl;
+	cout << "-j <path>      Output path for all files. Default: output/" << endl;
+	cout << "-w <path>      Directory that contains mempack. Default ''" << endl;
+	cout << "-c <int>       Number of cores to use. Default: all cores." << endl;
+	cout << "-g <0|1>       Generate helix layouts. Default 1." << endl;
+	cout << "-l <file>      Layout cache shared by the proteins of the run and later runs. Default: none." << endl;
+	cout << "-r <0|1>       Draw images with run_mempack.pl -render 1 (needs -g 1). Default 0." << endl;
+	cout << "-n <directory> NCBI binary directory (location of blastpgp and makemat)" << endl;
+	cout << "-d <path>      Database for running PSI-BLAST." << endl;
+	cout << "-p <int>       Cores per PSI-BLAST search. Default 1." << endl;
+	cout << "-k <path>      Cache directory for .mtx files, keyed by sequence and database. Default: none." << endl;
+	cout << "-h             Show help." << endl << endl;
+	exit(1);
+}
+
+int main(int argc, char* argv[]){
+
+	unsigned int threads = thread::hardware_concurrency();
+	int opt;
+	bool output_set = false;
+
+	while ((opt = getopt(argc, argv, "a:j:w:c:g:l:r:n:d:p:k:h")) != -1){
+		switch (opt){
+			case 'a': def = atoi(optarg); break;
+			case 'j': output_path = optarg; output_set = true; break;
+			case 'w': mem_dir = optarg; break;
+			case 'c': threads = atoi(optarg); break;
+			case 'g': layout = atoi(optarg) != 0; break;
+			case 'l': layout_cache_file = optarg; break;
+			case 'r': render = atoi(optarg) != 0; break;
+			case 'n': psiblast.ncbidir = optarg; break;
+			case 'd': psiblast.database = optarg; break;
+			case 'p': search_cores = atoi(optarg); break;
+			case 'k': psiblast.cache_dir = optarg; break;
+			default: usage();
+		}
+	}
+	if (optind >= argc) usage();
+	if (def < 1 || def > 3){
+		cout << "Contact definition must be 1, 2 or 3." << endl;
+		exit(1);
+	}
+	if (!threads) threads = 1;
+	if (!output_set) output_path = mem_dir + "output/";
+	if (output_path.empty() || output_path[output_path.size()-1] != '/') output_path += "/";
+	render_script = mem_dir + "run_mempack.pl";
+	if (!layout) render = false;
+
+	vector<batch_entry> entries;
+	if (!read_manifest(argv[optind], entries)){
+		cout << "Cannot open manifest " << argv[optind] << endl;
+		exit(1);
+	}
+	if (entries.empty()){
+		cout << "No proteins in manifest " << argv[optind] << endl;
+		exit(1);
+	}
+
+	// Fasta entries need PSI-BLAST
+	bool searches = false;
+	for (unsigned int i = 0; i < entries.size(); i++){
+		if (!entries[i].fasta.empty()) searches = true;
+	}
+	if (searches){
+		if (access((psiblast.ncbidir + "/blastpgp").c_str(), X_OK) || access((psiblast.ncbidir + "/makemat").c_str(), X_OK)){
+			cout << "Can't find blastpgp and makemat in the NCBI directory '" << psiblast.ncbidir << "'." << endl;
+			cout << "Please pass the correct NCBI location using the -n paramater." << endl;
+			exit(1);
+		}
+		if (psiblast.database.empty()){
+			cout << "The database name for PSI-BLAST searches has not been set. Please pass it using" << endl;
+			cout << "the -d paramater." << endl;
+			exit(1);
+		}
+		if (!psiblast.cache_dir.empty()) mkdir(psiblast.cache_dir.c_str(), 0755);
+		if (getenv("TMPDIR")) psiblast.tmp_dir = getenv("TMPDIR");
+		if (!search_cores) search_cores = 1;
+	}
+
+	// Models are read once and shared read-only by all workers
+	verbosity = 0;
+	string lipid_file = mem_dir + "models/LIPID_EXPOSURE_ALL.model";
+	ostringstream contact_file;
+	contact_file << mem_dir << "models/CONTACT_ALL_DEF" << def << ".model";
+	if (access(lipid_file.c_str(), R_OK)){
+		cout << lipid_file << " doesn't exist." << endl;
+		exit(1);
+	}
+	if (access(contact_file.str().c_str(), R_OK)){
+		cout << contact_file.str() << " doesn't exist." << endl;
+		exit(1);
+	}
+	lipid_model = read_model((char*)lipid_file.c_str());
+	if (lipid_model->kernel_parm.kernel_type == 0) add_weight_vector_to_linear_model(lipid_model);
+	contact_model = read_model((char*)contact_file.str().c_str());
+	if (contact_model->kernel_parm.kernel_type == 0) add_weight_vector_to_linear_model(contact_model);
+
+	cout << "Processing " << entries.size() << " proteins on " << threads << " cores..." << endl << endl;
+	double start = wall_time();
+
+	stage_scheduler scheduler(threads);
+	for (unsigned int i = 0; i < entries.size(); i++){
+		add_protein(scheduler, entries[i]);
+	}
+	scheduler.run();
+	proteins_failed = entries.size() - proteins_done;
+	save_layout_caches(cout);
+
+	double elapsed = wall_time() - start;
+	cout << endl << "Processed " << proteins_done << " proteins (" << proteins_failed << " failed) in " << elapsed << " s";
+	if (elapsed > 0) cout << ", " << (long)(proteins_done * 3600.0 / elapsed) << " proteins/hour";
+	cout << endl;
+	if (searches) cout << profiles_cached << " profiles were taken from the cache." << endl;
+
+	free_model(lipid_model, 1);
+	free_model(contact_model, 1);
+	return(proteins_failed ? 1 : 0);
+}
@@ -0,0 +1,126 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: The layout stage as a library call (libmempack_layout).
+// Given the helix boundaries and the predicted contacts of a protein
+// it builds the helix contact graph, lays out each connected
+// component, enumerates the alternative arrangements by swapping
+// helices and optimises the helix rotations of each, returning the
+// arrangements ranked by score. kk_plot is a command line front end
+// to it and mempack_batch calls it directly.
+//
+// Each call keeps its working state to itself, so calls from
+// different threads run at once; each uses options.threads threads of
+// its own.
+//
+
+#ifndef MEMPACK_LAYOUT_H
+#define MEMPACK_LAYOUT_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "paramopt.h"
+#include "kk_layout.h"
+
+using namespace std;
+
+// A predicted residue contact and the helices it links, helices
+// numbered from 1 as in the _CONTACT_DEF results files
+struct layout_contact {
+	int residue1, residue2;
+	int helix1, helix2;
+};
+
+struct layout_options {
+
+	// Helix layout: engine (LAYOUT_KK, LAYOUT_FAST or LAYOUT_SMACOF),
+	// starting positions tried, iteration cap and smacof tolerance
+	int engine;
+	unsigned int starts;
+	int iterations;
+	double tolerance;
+
+	// Rotation optimiser (OPTIMISER_GA, OPTIMISER_CD or OPTIMISER_DP)
+	// and its settings
+	int optimiser;
+	int cd_restarts;
+	int dp_bins;
+	int dp_max_width;
+	int ga_eval;
+	GAParams ga;
+
+	int threads;
+	unsigned long long seed;
+	bool warm_start;
+
+	// Rotation cache file, none if empty. See save_layout_caches.
+	string rotation_cache;
+
+	// Layout cache file, none if empty. Layouts are shared by proteins
+	// whose helix contact graphs differ only in their numbering.
+	string layout_cache;
+
+	// Best arrangements kept of each component, 0 for all. The others
+	// are released as soon as their rotations have been optimised.
+	unsigned int top;
+
+	// Report the helix swaps and loop crossovers on stdout
+	bool verbose;
+
+	layout_options();
+};
+
+struct placed_helix {
+
+	// Numbered from 1
+	int helix;
+	double x, y;
+	int rotation;
+};
+
+struct layout_arrangement {
+	vector<placed_helix> helices;
+	double score;
+};
+
+// Arrangements of one component of the helix contact graph, best
+// (lowest score) first. Arrangements with equal scores are reported once.
+struct layout_component {
+	vector<layout_arrangement> arrangements;
+};
+
+struct layout_result {
+	vector<layout_component> components;
+};
+
+// Topology (start and end residue of each helix) and contacts of a
+// _CONTACT_DEF results file. False if the stream can't be read.
+bool read_layout_input(istream& is, vector<int>& boundaries, vector<layout_contact>& contacts);
+
+// Lay out a protein. Progress is written to log as kk_plot reports it.
+// On bad input returns false with the reason in error.
+bool mempack_layout(const vector<int>& boundaries, const vector<layout_contact>& contacts, const layout_options& options,
+                    layout_result& result, ostream& log, string& error);
+
+// The arrangements in the form kk_plot prints and run_mempack.pl reads
+void write_layout_result(ostream& os, const layout_result& result);
+
+// The rotation and layout cache files are read once per process and
+// only written by this, which adds the entries of every call so far.
+// Each file is merged under a lock with what other processes have
+// written to it since. False if a file couldn't be written, named on log.
+bool save_layout_caches(ostream& log);
+
+#endif
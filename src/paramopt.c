@@ -30,8 +30,12 @@
 #include <sys/times.h>
 #include "globals.h"
 #include "draw_graphs.h"
+#include "paramopt.h"
+#include "rotation_dp.h"
+#include "work_queue.h"
 
 #define MAXPARAMS 1000
+#define MAXHINTS 8
 
 /* Utility definitions */
 
@@ -51,12 +55,11 @@
 #define dotprod(a,b) (a[0]*b[0]+a[1]*b[1]+a[2]*b[2])
 #define veccopy(a,b) ((a[0]=b[0]),(a[1]=b[1]),(a[2]=b[2]))
 
-double  minparam[MAXPARAMS], maxparam[MAXPARAMS];
-double vbest = VBIG;
-int ncalls = 0;
-short   paramtype[MAXPARAMS];
-
-char    progname[512];
+optimiser_settings::optimiser_settings() : optimiser(OPTIMISER_GA), cd_restarts(10), dp_bins(36), dp_max_width(3), ga_eval(GA_EVAL_INCREMENTAL)
+{
+    GAParams defaults = { 50, 0.1, 0.8, 1.0, 50, 0.0, 0, 0.0, 0, FALSE, FALSE };
+    ga = defaults;
+}
 
 
 typedef struct
@@ -64,13 +67,50 @@ typedef struct
     double         *genome;
     float           perfval, selval;
     short           evalflg;
+
+    /* Rotations and per-contact distances of the last evaluation, so
+       only contacts of helices changed since then are recomputed */
+    int            *evalrot;
+    double         *dist;
+    short           cached;
 }
 Schema;
 
-Schema  *curpool, *newpool;
-int      poolsize, genlen, *samparr, besti, rotation;
-float    mutrate, crosrate, mutscfac;
-double   worst, best, avc_perf;
+/* Everything one rotation search needs. The rotation tables hold the
+   engine's own copy of the contacts and helix positions, so engines
+   share nothing and any number can run at once. */
+struct Engine
+{
+    Rng             rng;
+    optimiser_settings settings;
+
+    double          minparam[MAXPARAMS], maxparam[MAXPARAMS];
+    short           paramtype[MAXPARAMS];
+
+    Schema         *curpool, *newpool;
+    int             poolsize, genlen, *samparr, besti, ncontacts, *evalidx;
+    double         *evalperf;
+    float           mutrate, crosrate, mutscfac;
+    double          scale, worst, best, avc_perf, vbest;
+    int             ncalls, bestcall;
+    struct timeval  start;
+
+    rotation_tables tables;
+
+    /* Best rotations found */
+    int             bestrot[MAXPARAMS];
+
+    /* Starting points from related searches, tried before random ones */
+    int             nhints;
+    int            *hints[MAXHINTS];
+
+    /* Threads scoring a generation and their workers, started on first use */
+    int             threads;
+    work_queue     *pool;
+
+    /* Messages, printed by the caller in arrangement order */
+    FILE           *out;
+};
 
 
 /* Dump a rude message to standard error and exit */
@@ -88,33 +128,29 @@ void fail(char *fmt, ...)
 
 /* Marsaglia Universal Double Precision Float RNG */
 
-double U[98];
-
-double uni64()
+double uni64(Rng *rng)
 {
     double x;
-    static double c = 0.0;
-    static int i=97, j=33;
     
-    x = U[i] - U[j];
+    x = rng->U[rng->i] - rng->U[rng->j];
 
     if (x < 0.0)
 	x += 1.0;
 
-    U[i] = x;
+    rng->U[rng->i] = x;
     
-    if (! --i)
-	i = 97;
+    if (! --rng->i)
+	rng->i = 97;
 
-    if (! --j)
-	j = 97;
+    if (! --rng->j)
+	rng->j = 97;
     
-    c -= 362436069876.0/9007199254740992.0;
+    rng->c -= 362436069876.0/9007199254740992.0;
 
-    if (c < 0.0)
-	c += 9007199254740881.0/9007199254740992.0;
+    if (rng->c < 0.0)
+	rng->c += 9007199254740881.0/9007199254740992.0;
     
-    x -= c;
+    x -= rng->c;
 
     if (x >= 0.0)
 	return x;
@@ -123,56 +159,56 @@ double uni64()
 }
 
 
-void randomise()
+/* Fill the lag table from a 64 bit seed with SplitMix64, so that
+   every seed, including consecutive ones, gives its own stream */
+void rng_seed(Rng *rng, unsigned long long seed)
+{
+    unsigned long long z;
+    int i;
+
+    for (i=1; i<98; i++) {
+	seed += 0x9E3779B97F4A7C15ULL;
+	z = seed;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	rng->U[i] = (z >> 11) * (1.0 / 9007199254740992.0);
+    }
+    rng->i = 97;
+    rng->j = 33;
+    rng->c = 0.0;
+}
+
+
+unsigned long long random_seed(void)
 {
-    double s,t;
-    int x = 0,y = 0,i,j;
+    unsigned long long x;
     struct timeval tv;
 
     /* Attempt to generate a random state unique to this process/host/time */
 
-    if (!gettimeofday(&tv, NULL))
-    {
-	x = tv.tv_sec;
-	y = tv.tv_usec;
-    }
-    else
-	fail("randomise: cannot generate random number seeds!");
+    if (gettimeofday(&tv, NULL))
+	fail("random_seed: cannot generate random number seeds!");
 
-    x ^= y;
-    
-    x ^= (unsigned int)gethostid();
-    y ^= (unsigned int)getpid();
+    x = (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+    x ^= (unsigned long long)(unsigned int)gethostid() << 32;
+    x ^= (unsigned long long)(unsigned int)getpid() << 16;
 
-    for (i=1; i<98; i++) {
-	s=0.0;
-	t=0.5;
-	
-	for(j=1; j<=53; j++)
-	{
-	    x=(6969*x)%65543;
-	    y=(8888*x)%65579;
-	    if (((x^y)&32)>0)
-		s += t;
-	    t *= 0.5;
-	}
-	
-	U[i]=s;
-    }
+    return x;
 }
 
 
 /* randint(a,b) : return random integer a <= n <= b */
-#define randint(low,high) ((int) ((low) + ((high)-(low)+1) * uni64()))
+#define randint(rng,low,high) ((int) ((low) + ((high)-(low)+1) * uni64(rng)))
 
 /* Generate gaussian deviate with mean 0 and stdev 1 */
-double gaussrnd()
+double gaussrnd(Rng *rng)
 {
     double x1, x2, w;
  
     do {
-	x1 = 2.0 * uni64() - 1.0;
-	x2 = 2.0 * uni64() - 1.0;
+	x1 = 2.0 * uni64(rng) - 1.0;
+	x2 = 2.0 * uni64(rng) - 1.0;
 	w = x1 * x1 + x2 * x2;
     } while (w >= 1.0);
 
@@ -182,69 +218,142 @@ double gaussrnd()
 }
 
 
-/* Evaluate given set of parameter values */
-double  eval(double *t)
+/* Score given schema, reusing what is cached from its last evaluation.
+   Only the schema is written to, so schemas can be scored in parallel. */
+double  score(Engine *e, Schema *sch)
 {
-    int i;
+    int i, rot[MAXPARAMS];
     
-    all_rotations[rotation].clear();	
-    for (i = 0; i < genlen; i++){
-    	all_rotations[rotation].push_back((int)t[i]);
-    }    
+    for (i = 0; i < e->genlen; i++)
+    	rot[i] = (int)sch->genome[i];
 
-    double v = optimise_rotation(rotation);
-	
-    ncalls++;
+    double v = update_rotation_score(e->tables, rot, sch->evalrot, sch->dist, sch->cached);
+    sch->cached = TRUE;
+    return v;
+}
+
+/* Score the flagged schemas first .. first+ROTATION_LANES-1 together */
+void score_block(Engine *e, Schema *pool, int first, int n)
+{
+    int i, k, lanes = MIN(ROTATION_LANES, n - first);
+    int *rot[ROTATION_LANES];
+    double *dist[ROTATION_LANES];
+    Schema *sch;
+
+    for (k = 0; k < lanes; k++)
+    {
+	sch = &pool[e->evalidx[first + k]];
+	for (i = 0; i < e->genlen; i++)
+	    sch->evalrot[i] = (int)sch->genome[i];
+	rot[k] = sch->evalrot;
+	dist[k] = sch->dist;
+	sch->cached = TRUE;
+    }
+
+    batch_rotation_scores(e->tables, rot, dist, lanes, e->evalperf + first);
+}
+
+/* Score job k of a generation: one schema, or one block of them */
+void score_job(Engine *e, Schema *pool, int k, int n)
+{
+    if (e->settings.ga_eval == GA_EVAL_BATCH)
+	score_block(e, pool, k * ROTATION_LANES, n);
+    else
+	e->evalperf[k] = score(e, &pool[e->evalidx[k]]);
+}
+
+/* Book-keeping for one evaluation, done in pool order whatever thread
+   scored it so the output does not depend on the number of threads */
+double  eval(Engine *e, Schema *sch, double v)
+{
+    int i;
+
+    e->ncalls++;
     
-    if (v < vbest)
+    if (v < e->vbest)
     {
-	printf("Best score %f after %d function evaluations.\n", v, ncalls);
-	vbest = v;
+	fprintf(e->out, "Best score %f after %d function evaluations.\n", v, e->ncalls);
+	e->vbest = v;
+	e->bestcall = e->ncalls;
+	for (i = 0; i < e->genlen; i++)
+	    e->bestrot[i] = (int)sch->genome[i];
     }
 
     return v;
 }
 
+/* Draw a genome at random */
+void randgenome(Engine *e, double *genome)
+{
+    int j;
+
+    for (j=0; j<e->genlen; j++)
+	if (!e->paramtype[j])
+	    genome[j] = randint(&e->rng, (int)e->minparam[j], (int)e->maxparam[j]);
+	else
+	    genome[j] = uni64(&e->rng) * (e->maxparam[j] - e->minparam[j]) + e->minparam[j];
+}
+
 /* Initialize the 'world' */
-void ga_init(void)
+void ga_init(Engine *e)
 {
     int i, j;
-    bool allocd = false;
 
     /* population arrays */
-    if (!allocd)
-    {
-	curpool = (Schema*) calloc(poolsize, sizeof(Schema));
-	newpool = (Schema*) calloc(poolsize, sizeof(Schema));
-	samparr = (int*) calloc(poolsize, sizeof(int));
+    e->curpool = (Schema*) calloc(e->poolsize, sizeof(Schema));
+    e->newpool = (Schema*) calloc(e->poolsize, sizeof(Schema));
+    e->samparr = (int*) calloc(e->poolsize, sizeof(int));
+    e->evalidx = (int*) calloc(e->poolsize, sizeof(int));
+    e->evalperf = (double*) calloc(e->poolsize, sizeof(double));
 
-	if (!curpool || !newpool || !samparr)
-	    fail("ga_init: cannot create population arrays!");
-    }
+    if (!e->curpool || !e->newpool || !e->samparr || !e->evalidx || !e->evalperf)
+	fail("ga_init: cannot create population arrays!");
 
-    for (i = 0; i < poolsize; i++)
+    for (i = 0; i < e->poolsize; i++)
     {
-	if (!allocd)
-	{
+	e->curpool[i].genome = (double*) calloc(e->genlen, sizeof(double));
+	e->newpool[i].genome = (double*) calloc(e->genlen, sizeof(double));
+	e->curpool[i].evalrot = (int*) calloc(e->genlen, sizeof(int));
+	e->newpool[i].evalrot = (int*) calloc(e->genlen, sizeof(int));
+	e->curpool[i].dist = (double*) calloc(e->ncontacts + 1, sizeof(double));
+	e->newpool[i].dist = (double*) calloc(e->ncontacts + 1, sizeof(double));
 
-	    curpool[i].genome = (double*) calloc(genlen, sizeof(double));
-	    newpool[i].genome = (double*) calloc(genlen, sizeof(double));
+	if (e->curpool[i].genome == NULL || e->newpool[i].genome == NULL || e->curpool[i].evalrot == NULL || e->newpool[i].evalrot == NULL || e->curpool[i].dist == NULL || e->newpool[i].dist == NULL)
+	    fail("ga_init: cannot create schema!");
 
-	    if (curpool[i].genome == NULL || newpool[i].genome == NULL)
-		fail("ga_init: cannot create schema!");
-	}
+	e->curpool[i].cached = e->newpool[i].cached = FALSE;
 
 	/* Initialize population with random values */
-	for (j=0; j<genlen; j++)
-	    if (!paramtype[j])
-		curpool[i].genome[j] = randint((int)minparam[j], (int)maxparam[j]);
-	    else
-		curpool[i].genome[j] = uni64() * (maxparam[j] - minparam[j]) + minparam[j];
-    
-	curpool[i].evalflg = TRUE;
+	randgenome(e, e->curpool[i].genome);
+	e->curpool[i].evalflg = TRUE;
     }
-    
-    allocd = true;
+
+    /* Warm start: hints replace the first random members, the rest of
+       the pool stays random to keep the search broad */
+    for (i = 0; i < MIN(e->nhints, e->poolsize); i++)
+	for (j=0; j<e->genlen; j++)
+	    e->curpool[i].genome[j] = MAX(e->minparam[j], MIN(e->maxparam[j], e->hints[i][j]));
+}
+
+/* Release the population arrays */
+void ga_free(Engine *e)
+{
+    int i;
+
+    for (i = 0; i < e->poolsize; i++)
+    {
+	free(e->curpool[i].genome);
+	free(e->newpool[i].genome);
+	free(e->curpool[i].evalrot);
+	free(e->newpool[i].evalrot);
+	free(e->curpool[i].dist);
+	free(e->newpool[i].dist);
+    }
+    free(e->curpool);
+    free(e->newpool);
+    free(e->samparr);
+    free(e->evalidx);
+    free(e->evalperf);
 }
 
 int schcmp(const void *sch1, const void *sch2)
@@ -257,242 +366,483 @@ int schcmp(const void *sch1, const void *sch2)
     return 0;
 }
 
+/* Copy a schema along with its evaluation cache */
+void copyschema(Engine *e, Schema *to, Schema *from)
+{
+    memcpy(to->genome, from->genome, e->genlen * sizeof(double));
+    to->perfval = from->perfval;
+    to->cached = from->cached;
+    if (from->cached)
+    {
+	memcpy(to->evalrot, from->evalrot, e->genlen * sizeof(int));
+	memcpy(to->dist, from->dist, e->ncontacts * sizeof(double));
+    }
+}
+
 /* Sort pool into ascending order of perfval */
-void            sortpool(Schema * pool)
+void            sortpool(Engine *e, Schema * pool)
 {
-    qsort((void *) pool, poolsize, sizeof(Schema), schcmp);
+    qsort((void *) pool, e->poolsize, sizeof(Schema), schcmp);
 }
 
 /* Select new population from old */
-void gaselect(void)
+void gaselect(Engine *e)
 {
     double          ptr;	/* determines fractional selection       */
     double          sum;	/* control for selection loop           */
     double          fitsum;	/* sum of fitness values */
     int             i,k;
+    Schema         *curpool = e->curpool, *newpool = e->newpool;
 
 #if 1
-    sortpool(curpool);
+    sortpool(e, curpool);
 
     /* denominator for ordinal selection probabilities */
-    for (fitsum = i = 0; i < poolsize; i++)
+    for (fitsum = i = 0; i < e->poolsize; i++)
     {
-	curpool[i].selval = poolsize - i;
+	curpool[i].selval = e->poolsize - i;
 	fitsum += curpool[i].selval;
-	if (curpool[i].perfval == best)
-	    besti = i;
+	if (curpool[i].perfval == e->best)
+	    e->besti = i;
     }
 #else
     /* denominator for selection probabilities */
-    for (fitsum = i = 0; i < poolsize; i++)
+    for (fitsum = i = 0; i < e->poolsize; i++)
     {
-	curpool[i].selval = worst - curpool[i].perfval;
+	curpool[i].selval = e->worst - curpool[i].perfval;
 	fitsum += curpool[i].selval;
-	if (curpool[i].perfval == best)
-	    besti = i;
+	if (curpool[i].perfval == e->best)
+	    e->besti = i;
     }
 #endif
 
-    for (i = 0; i < poolsize; i++)
+    for (i = 0; i < e->poolsize; i++)
     {
 	sum = 0.0;
 	k = -1;			/* index of next Selected structure */
 
-	ptr = fitsum * uni64();	/* spin the wheel one time */
+	ptr = fitsum * uni64(&e->rng);	/* spin the wheel one time */
 
 	do
 	{
 	    k++;
 	    sum += curpool[k].selval;
 	}
-	while (sum < ptr && k < poolsize - 1);
+	while (sum < ptr && k < e->poolsize - 1);
 
-	samparr[i] = k;
+	e->samparr[i] = k;
     }
 
 #if 0
     /* randomly shuffle indices to new structures */
-    for (i = 0; i < poolsize; i++)
+    for (i = 0; i < e->poolsize; i++)
     {
-	j = randint(i, poolsize - 1);
-	temp = samparr[j];
-	samparr[j] = samparr[i];
-	samparr[i] = temp;
+	j = randint(&e->rng, i, e->poolsize - 1);
+	temp = e->samparr[j];
+	e->samparr[j] = e->samparr[i];
+	e->samparr[i] = temp;
     }
 #endif
 
     /* Form the new population */
-    for (i = 0; i < poolsize; i++)
+    for (i = 0; i < e->poolsize; i++)
     {
-	k = samparr[i];
-	memcpy(newpool[i].genome, curpool[k].genome, genlen * sizeof(double));
-	newpool[i].perfval = curpool[k].perfval;
+	k = e->samparr[i];
+	copyschema(e, &newpool[i], &curpool[k]);
 	newpool[i].evalflg = FALSE;
     }
 
 #ifdef ELITIST
     /* Elitist strategy... */
-/*    printf("besti = %d %f %f\n", besti, best, curpool[besti].perfval); */
-    memcpy(newpool[besti].genome, curpool[besti].genome, genlen * sizeof(double));
-    newpool[besti].perfval = curpool[besti].perfval;
-    newpool[besti].evalflg = FALSE;
+/*    printf("besti = %d %f %f\n", e->besti, e->best, curpool[e->besti].perfval); */
+    copyschema(e, &newpool[e->besti], &curpool[e->besti]);
+    newpool[e->besti].evalflg = FALSE;
 #endif
 }
 
 
-void mutate(float prob)
+void mutate(Engine *e, float prob)
 {
     int i, j;
     double delta;
-    static double scale=0.25;
+    Schema *newpool = e->newpool;
 
     if (prob > 0.0)
-	for (i = 0; i<poolsize; i++)
-	    if (i != besti)
-		for (j=0; j<genlen; j++)
-		    if (uni64() < prob)
+	for (i = 0; i<e->poolsize; i++)
+	    if (i != e->besti)
+		for (j=0; j<e->genlen; j++)
+		    if (uni64(&e->rng) < prob)
 		    {
-			delta = scale * gaussrnd() * (maxparam[j] - minparam[j]);
+			delta = e->scale * gaussrnd(&e->rng) * (e->maxparam[j] - e->minparam[j]);
 			
-			if (!paramtype[j] && delta > -1.0 && delta < 1.0 )
+			if (!e->paramtype[j] && delta > -1.0 && delta < 1.0 )
 			    delta = (delta < 0.0) ? -1.0 : 1.0;
 
 			newpool[i].genome[j] += delta;
 
-			if (newpool[i].genome[j] > maxparam[j])
-			    newpool[i].genome[j] = maxparam[j];
-			if (newpool[i].genome[j] < minparam[j])
-			    newpool[i].genome[j] = minparam[j];
+			if (newpool[i].genome[j] > e->maxparam[j])
+			    newpool[i].genome[j] = e->maxparam[j];
+			if (newpool[i].genome[j] < e->minparam[j])
+			    newpool[i].genome[j] = e->minparam[j];
 
 			newpool[i].evalflg = TRUE;
 		    }
     /* Apply mutation scaling factor */
-    scale *= mutscfac;
+    e->scale *= e->mutscfac;
 }
 
 /* Randomly crossover pool */
-void crossovr(void)
+void crossovr(Engine *e)
 {
     int             i,p1;
     double          old1[MAXPARAMS], old2[MAXPARAMS];
+    Schema         *newpool = e->newpool;
 
-    for (i = 0; i < poolsize - 1; i += 2)
-	if (uni64() < crosrate)
+    for (i = 0; i < e->poolsize - 1; i += 2)
+	if (uni64(&e->rng) < e->crosrate)
 	{
 
 #ifdef ELITIST
-	    if (i == besti || i + 1 == besti)
+	    if (i == e->besti || i + 1 == e->besti)
 		continue;
 #endif
 
 	    /* Multi point crossover */
 
-	    memcpy(old1, newpool[i].genome, genlen * sizeof(double));
-	    memcpy(old2, newpool[i + 1].genome, genlen * sizeof(double));
+	    memcpy(old1, newpool[i].genome, e->genlen * sizeof(double));
+	    memcpy(old2, newpool[i + 1].genome, e->genlen * sizeof(double));
 
-	    for (p1=0; p1 < genlen; p1++)
-		if (uni64() < 0.5)
+	    for (p1=0; p1 < e->genlen; p1++)
+		if (uni64(&e->rng) < 0.5)
 		{
 		    newpool[i].genome[p1] = newpool[i + 1].genome[p1];
 		    newpool[i + 1].genome[p1] = old1[p1];
 		}
 
-	    if (memcmp(newpool[i].genome, old1, genlen * sizeof(double)))
+	    if (memcmp(newpool[i].genome, old1, e->genlen * sizeof(double)))
 		newpool[i].evalflg = TRUE;
-	    if (memcmp(newpool[i + 1].genome, old2, genlen * sizeof(double)))
+	    if (memcmp(newpool[i + 1].genome, old2, e->genlen * sizeof(double)))
 		newpool[i + 1].evalflg = TRUE;
 	}
 }
 
-void statistics(Schema * pool)
+void statistics(Engine *e, Schema * pool)
 {
-    int             i;
+    int             i, n, jobs, lanes;
 
-    for (i = 0; i < poolsize; i++)
+    for (n = i = 0; i < e->poolsize; i++)
 	if (pool[i].evalflg)
-	{
-	    pool[i].perfval = eval(pool[i].genome);
-	    pool[i].evalflg = FALSE;
-	}
+	    e->evalidx[n++] = i;
+
+    jobs = (e->settings.ga_eval == GA_EVAL_BATCH) ? (n + ROTATION_LANES - 1) / ROTATION_LANES : n;
+    lanes = MIN(e->threads, jobs);
+    if (lanes > 1)
+    {
+	if (!e->pool)
+	    e->pool = new work_queue(e->threads);
+
+	/* Each worker takes every lanes-th job */
+	for (i = 0; i < lanes; i++)
+	    e->pool->push([e, pool, i, n, jobs, lanes]() {
+		for (int k = i; k < jobs; k += lanes)
+		    score_job(e, pool, k, n);
+	    });
+	e->pool->wait();
+    }
+    else
+	for (i = 0; i < jobs; i++)
+	    score_job(e, pool, i, n);
+
+    for (i = 0; i < n; i++)
+    {
+	pool[e->evalidx[i]].perfval = eval(e, &pool[e->evalidx[i]], e->evalperf[i]);
+	pool[e->evalidx[i]].evalflg = FALSE;
+    }
 
-    avc_perf = best = worst = pool[0].perfval;
+    e->avc_perf = e->best = e->worst = pool[0].perfval;
 
-    for (i = 1; i < poolsize; i++)
+    for (i = 1; i < e->poolsize; i++)
     {
-	avc_perf += pool[i].perfval;
-	if (pool[i].perfval > worst)
-	    worst = pool[i].perfval;
-	if (pool[i].perfval < best)
-	    best = pool[i].perfval;
+	e->avc_perf += pool[i].perfval;
+	if (pool[i].perfval > e->worst)
+	    e->worst = pool[i].perfval;
+	if (pool[i].perfval < e->best)
+	    e->best = pool[i].perfval;
     }
 
-    avc_perf /= (float) poolsize;
+    e->avc_perf /= (float) e->poolsize;
 }
 
-void run_ga(void)
+/* Seconds since engine_run started */
+double elapsed(Engine *e)
 {
-    int             gen, prevgen = 0,opt_flag;
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec - e->start.tv_sec) + (tv.tv_usec - e->start.tv_usec) / 1e6;
+}
+
+/* Restart from the elite: every member but the best is drawn again at
+   random and the mutation step goes back to its initial size */
+void restartpool(Engine *e, Schema *pool)
+{
+    int i, elite = 0;
+
+    for (i = 1; i < e->poolsize; i++)
+	if (pool[i].perfval < pool[elite].perfval)
+	    elite = i;
+
+    for (i = 0; i < e->poolsize; i++)
+	if (i != elite)
+	{
+	    randgenome(e, pool[i].genome);
+	    pool[i].evalflg = TRUE;
+	}
+
+    e->scale = 0.25;
+}
+
+void run_ga(Engine *e)
+{
+    int             gen, prevgen = 0,opt_flag, restarts = 0, restart;
     float           prevbest;
+    double          initial;
+    const char     *stopped = NULL;
     Schema         *temp;
 
     prevbest = VBIG;
 
-    statistics(curpool);
+    statistics(e, e->curpool);
+    initial = e->best;
     
-    //printf("Initial: %g %g %g\n\n", worst, avc_perf, best);
+    //printf("Initial: %g %g %g\n\n", e->worst, e->avc_perf, e->best);
 
     for (gen = 1;; gen++)
     {
-	gaselect();
+	gaselect(e);
 
-	crossovr();
-	mutate(mutrate);
+	crossovr(e);
+	mutate(e, e->mutrate);
 	    
-	statistics(newpool);
+	statistics(e, e->newpool);
 	    
-	//printf("%d %g %g %g\n", gen, worst, avc_perf, best);
-	fflush(stdout);
+	//printf("%d %g %g %g\n", gen, e->worst, e->avc_perf, e->best);
 	    
-	if (best < prevbest)
+	/* Only an improvement of at least min_improvement of the best
+	   score so far counts as progress */
+	if (e->best < prevbest - fabs(prevbest) * e->settings.ga.min_improvement)
 	{
-	    prevbest = best;
+	    prevbest = e->best;
 	    prevgen = gen;
 	    opt_flag = TRUE;
+
+	    /* Adaptive mutation: smaller steps while the search is
+	       improving, larger ones while it is stuck */
+	    if (e->settings.ga.adaptive)
+		e->scale = MAX(e->scale * 0.9, 0.02);
 	}
+	else if (e->settings.ga.adaptive)
+	    e->scale = MIN(e->scale * 1.02, 0.5);
 
-	if (gen - prevgen > 50 || worst == best)
+	restart = FALSE;
+	if (e->settings.ga.max_evals && e->ncalls >= e->settings.ga.max_evals)
 	{
-	    puts("*** Convergence detected!");
-	    break;
+	    fputs("*** Evaluation budget reached!\n", e->out);
+	    stopped = "evaluation budget";
+	}
+	else if (e->settings.ga.max_time > 0.0 && elapsed(e) >= e->settings.ga.max_time)
+	{
+	    fputs("*** Time limit reached!\n", e->out);
+	    stopped = "time limit";
 	}
+	else if (gen - prevgen > e->settings.ga.stall || e->worst == e->best)
+	{
+	    if (restarts < e->settings.ga.restarts)
+		restart = TRUE;
+	    else
+	    {
+		fputs("*** Convergence detected!\n", e->out);
+		stopped = "convergence";
+	    }
+	}
+	if (stopped)
+	    break;
 	
-	temp = newpool;
-	newpool = curpool;
-	curpool = temp;
+	temp = e->newpool;
+	e->newpool = e->curpool;
+	e->curpool = temp;
+
+	if (restart)
+	{
+	    restartpool(e, e->curpool);
+	    statistics(e, e->curpool);
+	    restarts++;
+	    prevgen = gen;
+	}
+    }
+
+    if (e->settings.ga.stats)
+    {
+	fprintf(e->out, "GA: %d generations, %d evaluations, %d restarts, stopped by %s, %.3f s\n", gen, e->ncalls, restarts, stopped, elapsed(e));
+	fprintf(e->out, "GA: best score %f at start, %f after %d evaluations, %.2f%% lower\n", initial, e->vbest, e->bestcall, initial > 0.0 ? 100.0 * (initial - e->vbest) / initial : 0.0);
     }
 }
 
+/*
+ * Cyclic coordinate descent. With the other helices fixed, the cost of
+ * one helix is the distance summed over its own contacts, so its best
+ * rotation is found exactly by scanning all 360 whole-degree angles.
+ * Helices are visited in turn until a full cycle changes nothing, and
+ * the descent is restarted from random rotations cd_restarts times.
+ */
+void run_cd(Engine *e)
+{
+    int i, h, r, restart, changed, bestrot;
+    double cost, mincost;
+    int *rot, *bestset, *evalrot;
+    double *dist;
+
+    rot = (int*) calloc(e->genlen, sizeof(int));
+    bestset = (int*) calloc(e->genlen, sizeof(int));
+    evalrot = (int*) calloc(e->genlen, sizeof(int));
+    dist = (double*) calloc(e->ncontacts + 1, sizeof(double));
+    if (!rot || !bestset || !evalrot || !dist)
+	fail("run_cd: cannot create rotation arrays!");
+
+    e->best = VBIG;
+
+    for (restart = 0; restart < MAX(e->settings.cd_restarts, 1); restart++)
+    {
+	for (i = 0; i < e->genlen; i++)
+	    rot[i] = randint(&e->rng, (int)e->minparam[i], (int)e->maxparam[i]);
+
+	/* The first descents start from the hints */
+	if (restart < e->nhints)
+	    for (i = 0; i < e->genlen; i++)
+		rot[i] = MAX((int)e->minparam[i], MIN((int)e->maxparam[i], e->hints[restart][i]));
+
+	do
+	{
+	    changed = FALSE;
+	    for (h = 0; h < e->genlen; h++)
+	    {
+		bestrot = rot[h];
+		mincost = helix_contact_distance(e->tables, h, rot, rot[h]);
+		for (r = (int)e->minparam[h]; r <= (int)e->maxparam[h]; r++)
+		{
+		    cost = helix_contact_distance(e->tables, h, rot, r);
+		    if (cost < mincost)
+		    {
+			mincost = cost;
+			bestrot = r;
+		    }
+		}
+		e->ncalls += (int)e->maxparam[h] - (int)e->minparam[h] + 1;
+		if (bestrot != rot[h])
+		{
+		    rot[h] = bestrot;
+		    changed = TRUE;
+		}
+	    }
+	}
+	while (changed);
+
+	/* Full score, summed the same way as the GA's */
+	cost = update_rotation_score(e->tables, rot, evalrot, dist, FALSE);
+	if (cost < e->vbest)
+	{
+	    fprintf(e->out, "Best score %f after %d function evaluations.\n", cost, e->ncalls);
+	    e->vbest = cost;
+	}
+	if (cost < e->best)
+	{
+	    e->best = cost;
+	    memcpy(bestset, rot, e->genlen * sizeof(int));
+	}
+    }
+
+    fputs("*** Convergence detected!\n", e->out);
+
+    memcpy(e->bestrot, bestset, e->genlen * sizeof(int));
+
+    free(rot);
+    free(bestset);
+    free(evalrot);
+    free(dist);
+}
+
+/*
+ * Exact optimum over dp_bins equally spaced rotations per helix by
+ * variable elimination on the helix contact graph. Falls back to
+ * coordinate descent when the tree width is above dp_max_width, or
+ * when dp_bins^(width+1) is too large to work through, as the tables
+ * would grow too large.
+ */
+void run_dp(Engine *e)
+{
+    int width, bins = e->settings.dp_bins, max_width = e->settings.dp_max_width;
+    long evaluations;
+    int *rot, *evalrot;
+    double *dist;
+
+    rot = (int*) calloc(e->genlen, sizeof(int));
+    evalrot = (int*) calloc(e->genlen, sizeof(int));
+    dist = (double*) calloc(e->ncontacts + 1, sizeof(double));
+    if (!rot || !evalrot || !dist)
+	fail("run_dp: cannot create rotation arrays!");
+
+    if (!optimise_rotation_dp(e->tables, e->genlen, bins, max_width, rot, width, evaluations))
+    {
+	if (width > max_width)
+	    fprintf(e->out, "Tree width %d of the helix contact graph is above %d, using coordinate descent.\n", width, max_width);
+	else
+	    fprintf(e->out, "Tables of %d rotation bins at tree width %d would be too large, using coordinate descent.\n", bins, width);
+	run_cd(e);
+    }
+    else
+    {
+	e->ncalls += evaluations;
+	e->best = e->vbest = update_rotation_score(e->tables, rot, evalrot, dist, FALSE);
+	fprintf(e->out, "Best score %f after %d function evaluations.\n", e->best, e->ncalls);
+	fprintf(e->out, "Exact optimum over %d rotation bins, tree width %d.\n", bins, width);
+
+	memcpy(e->bestrot, rot, e->genlen * sizeof(int));
+    }
+
+    free(rot);
+    free(evalrot);
+    free(dist);
+}
+
 /* Read parameters */
-void readparams(int helices){
-
-	genlen = helices;
-	poolsize = 50;
-	mutrate = 0.1;
-	crosrate = 0.8;
-	mutscfac = 1;
-
-	for (int i=0; i<genlen; i++){
-		paramtype[i] = 1;
-		minparam[i] = 0;
-		maxparam[i] = 359;
+void readparams(Engine *e, int helices){
+
+	e->genlen = helices;
+	e->poolsize = MAX(e->settings.ga.poolsize, 2);
+	e->mutrate = e->settings.ga.mutrate;
+	e->crosrate = e->settings.ga.crosrate;
+	e->mutscfac = e->settings.ga.mutscfac;
+	e->scale = 0.25;
+
+	for (int i=0; i<e->genlen; i++){
+		e->paramtype[i] = 1;
+		e->minparam[i] = 0;
+		e->maxparam[i] = 359;
    	 }
 }
 
-double optimise_parameters(int helices, int r){
+Engine *engine_new(const optimiser_settings& settings, const xy_array& helix_positions, const vector<int>& boundaries, const vector<pair<int,int> >& contacts,
+                   unsigned int residue_count, unsigned long long seed){
+
+	Engine *e = new Engine();
+	int helices = helix_positions.x.size();
 
-    	rotation = r;
-    	vbest = VBIG;
-	ncalls = 0;
+	e->settings = settings;
+    	e->vbest = VBIG;
+	e->ncalls = 0;
+	e->ncontacts = contacts.size();
+	e->threads = 1;
+	prepare_rotation_tables(e->tables, helix_positions, boundaries, contacts, residue_count);
 
    	 /*
     	printf("Optimum Parameter Search Program\n");
@@ -500,20 +850,69 @@ double optimise_parameters(int helices, int r){
     	printf("Copyright (C) 1994/2005 David T. Jones\n\n");
     	*/
 
-    	randomise();
-    	readparams(helices);
+    	rng_seed(&e->rng, seed);
+    	readparams(e, helices);
 
     	/*
-    	printf("Number of parameters = %d\n", genlen);
-    	printf("Pool size = %d\n", poolsize);
-    	printf("Mutation rate = %f\n", mutrate);
-   	 printf("Crossover rate = %f\n", crosrate);
-    	printf("Mutation scaling factor = %f\n", mutscfac);
+    	printf("Number of parameters = %d\n", e->genlen);
+    	printf("Pool size = %d\n", e->poolsize);
+    	printf("Mutation rate = %f\n", e->mutrate);
+   	 printf("Crossover rate = %f\n", e->crosrate);
+    	printf("Mutation scaling factor = %f\n", e->mutscfac);
     	*/
 
-    	ga_init();
-    	run_ga();
-    	printf("Best score:\t%f\n",best);
-	return(best);
+	return(e);
+}
+
+double engine_run(Engine *e, int threads, string& report){
+
+	char *buf = NULL;
+	size_t len = 0;
+
+	e->threads = threads;
+	gettimeofday(&e->start, NULL);
+	e->out = open_memstream(&buf, &len);
+	if (!e->out)
+		fail("engine_run: cannot create message buffer!");
+
+	if (e->settings.optimiser == OPTIMISER_CD){
+		run_cd(e);
+	}else if (e->settings.optimiser == OPTIMISER_DP){
+		run_dp(e);
+	}else{
+	    	ga_init(e);
+	    	run_ga(e);
+	    	ga_free(e);
+	}
+    	fprintf(e->out, "Best score:\t%f\n",e->best);
+
+	fclose(e->out);
+	e->out = NULL;
+	report.assign(buf, len);
+	free(buf);
+
+	return(e->best);
+}
+
+void engine_hint(Engine *e, const int *rotations){
+
+	if (e->nhints == MAXHINTS)
+		return;
+	e->hints[e->nhints] = (int*) malloc(e->genlen * sizeof(int));
+	if (!e->hints[e->nhints])
+		fail("engine_hint: cannot create hint!");
+	memcpy(e->hints[e->nhints++], rotations, e->genlen * sizeof(int));
+}
+
+void engine_best(Engine *e, int *rotations){
+
+	memcpy(rotations, e->bestrot, e->genlen * sizeof(int));
+}
+
+void engine_free(Engine *e){
 
+	for (int i = 0; i < e->nhints; i++)
+		free(e->hints[i]);
+	delete e->pool;
+	delete e;
 }
@@ -10,6 +10,88 @@
 #ifndef PARAMOPT_H
 #define PARAMOPT_H
 
-double optimise_parameters(int,int);
+#include <string>
+#include <vector>
+#include "globals.h"
+
+using namespace std;
+
+// Rotation optimisers
+enum { OPTIMISER_GA, OPTIMISER_CD, OPTIMISER_DP };
+
+// How the ga scores a generation: schema by schema, recomputing only
+// the contacts of changed helices, or ROTATION_LANES schemas at a time
+enum { GA_EVAL_INCREMENTAL, GA_EVAL_BATCH };
+
+// Genetic algorithm settings, defaults in brackets
+typedef struct
+{
+    int poolsize;           // Population size [50]
+    float mutrate;          // Chance of mutating each gene [0.1]
+    float crosrate;         // Chance of crossing over each pair [0.8]
+    float mutscfac;         // Mutation step scale factor per generation [1]
+    int stall;              // Generations without progress before stopping [50]
+    double min_improvement; // Relative improvement that counts as progress [0]
+    int max_evals;          // Stop after this many evaluations, 0 for no limit [0]
+    double max_time;        // Stop after this many seconds, 0 for no limit [0]
+    int restarts;           // Restarts from the elite instead of stopping [0]
+    short adaptive;         // Adapt the mutation step to progress [off]
+    short stats;            // Report generations, evaluations and improvement [off]
+}
+GAParams;
+
+// Optimiser and its settings. Each engine has its own copy, so engines
+// with different settings can run at once.
+struct optimiser_settings
+{
+    int optimiser;          // OPTIMISER_GA, OPTIMISER_CD or OPTIMISER_DP [ga]
+    int cd_restarts;        // Random restarts of cd [10]
+    int dp_bins;            // Rotation bins per helix of dp [36]
+    int dp_max_width;       // Largest tree width dp accepts [3]
+    int ga_eval;            // GA_EVAL_INCREMENTAL or GA_EVAL_BATCH [incremental]
+    GAParams ga;
+
+    optimiser_settings();
+};
+
+// Marsaglia universal RNG. Every engine has a stream of its own, so
+// engines can run at once and a seed reproduces a run exactly.
+typedef struct
+{
+    double U[98], c;
+    int i, j;
+}
+Rng;
+
+void rng_seed(Rng *rng, unsigned long long seed);
+double uni64(Rng *rng);
+
+// Seed from the time, host and process id, for runs without --seed
+unsigned long long random_seed(void);
+
+// Rotation optimiser for one arrangement, holding its own population,
+// statistics, rotation tables and RNG stream
+typedef struct Engine Engine;
+
+// An engine with the given settings for the helices at helix_positions,
+// with the given boundaries (start and end residue of each helix) and
+// residue contacts, residue numbers below residue_count. The engine
+// keeps its own copy of all of them.
+Engine *engine_new(const optimiser_settings& settings, const xy_array& helix_positions, const vector<int>& boundaries, const vector<pair<int,int> >& contacts,
+                   unsigned int residue_count, unsigned long long seed);
+
+// Optimise the rotations, scoring each ga generation on threads
+// threads. Writes the progress messages to report and returns the best
+// score; the rotations that gave it are read with engine_best.
+double engine_run(Engine *e, int threads, string& report);
+
+// Warm start: add a set of rotations, such as the best of a related
+// arrangement, as a starting point. The ga seeds part of its first
+// population with the hints and cd starts its first descents there.
+void engine_hint(Engine *e, const int *rotations);
+
+// Best rotations found by engine_run
+void engine_best(Engine *e, int *rotations);
+void engine_free(Engine *e);
 
 #endif
@@ -0,0 +1,213 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: PSI-BLAST profile generation (run_psiblast in
+// run_mempack.pl). Every search runs in its own temporary directory
+// so any number can run at once, and finished .mtx files are kept in
+// an on-disk cache keyed by a hash of the sequence and the identity
+// of the database it was searched against.
+//
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "profiles.h"
+#include "rotation_cache.h"
+
+using namespace std;
+
+bool read_fasta(const string& fasta, string& sequence){
+
+	ifstream is(fasta.c_str());
+	if (!is.good()) return false;
+
+	sequence.clear();
+	string line;
+	while (getline(is, line)){
+		if (!line.empty() && line[0] == '>'){
+			// Only the first sequence is used
+			if (!sequence.empty()) break;
+			continue;
+		}
+		for (unsigned int i = 0; i < line.size(); i++){
+			if (!isspace(line[i])) sequence += line[i];
+		}
+	}
+	return !sequence.empty();
+}
+
+static string absolute_path(const string& path){
+
+	if (path.empty() || path[0] == '/') return(path);
+	char cwd[4096];
+	if (!getcwd(cwd, sizeof(cwd))) return(path);
+	return(string(cwd) + "/" + path);
+}
+
+// Index files of a protein database, single volume or alias
+static const char* db_extensions[] = {".pal", ".pin", ".phr", ".psq", NULL};
+
+string database_identity(const string& database){
+
+	ostringstream id;
+	id << database;
+	for (unsigned int i = 0; db_extensions[i]; i++){
+		struct stat st;
+		if (!stat((database + db_extensions[i]).c_str(), &st)){
+			id << " " << db_extensions[i] << ":" << st.st_size << ":" << st.st_mtime;
+		}
+	}
+	return(id.str());
+}
+
+// Copy into place through a temporary file, so another process never
+// sees a half written .mtx
+static bool install_file(const string& from, const string& to){
+
+	ifstream is(from.c_str(), ios::binary);
+	if (!is.good()) return false;
+	ostringstream contents;
+	contents << is.rdbuf();
+	return(!is.bad() && replace_file(to, contents.str()));
+}
+
+// A path as one word of a shell command, whatever it holds
+static string shell_quote(const string& path){
+
+	string quoted = "'";
+	for (unsigned int i = 0; i < path.size(); i++){
+		if (path[i] == '\'') quoted += "'\\''";
+		else quoted += path[i];
+	}
+	return(quoted + "'");
+}
+
+// True if command ran and exited with status 0. makemat can leave a
+// partial .mtx behind when it fails, so its status is checked as well
+// as its output.
+static bool run_command(const string& command){
+
+	int status = system(command.c_str());
+	return(status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// A cached profile is only used if it was made for this sequence
+static bool mtx_matches(const string& mtx, const string& sequence){
+
+	ifstream is(mtx.c_str());
+	string line, mtx_sequence;
+	if (!getline(is, line) || !getline(is, line)) return false;
+	for (unsigned int i = 0; i < line.size(); i++){
+		if (!isspace(line[i])) mtx_sequence += line[i];
+	}
+	return(mtx_sequence == sequence);
+}
+
+static void remove_dir(const string& dir){
+
+	DIR* d = opendir(dir.c_str());
+	if (d){
+		struct dirent* entry;
+		while ((entry = readdir(d))){
+			string name = entry->d_name;
+			if (name != "." && name != "..") remove((dir + "/" + name).c_str());
+		}
+		closedir(d);
+	}
+	rmdir(dir.c_str());
+}
+
+static bool write_text(const string& file, const string& text){
+
+	ofstream os(file.c_str());
+	os << text;
+	os.close();
+	return(os.good());
+}
+
+bool make_profile(const search_config& config, const string& fasta, const string& mtx_out, unsigned int cores, bool& cached, string& message){
+
+	cached = false;
+	string sequence;
+	if (!read_fasta(fasta, sequence)){
+		message = "Fasta file " + fasta + " doesn't exist or holds no sequence";
+		return false;
+	}
+
+	string cache_file;
+	if (!config.cache_dir.empty()){
+		cache_file = config.cache_dir + "/" + hash_key(sequence + "\n" + database_identity(config.database)) + ".mtx";
+		if (mtx_matches(cache_file, sequence) && install_file(cache_file, mtx_out)){
+			cached = true;
+			return true;
+		}
+	}
+
+	// blastpgp and makemat write fixed file names (and error.log) into
+	// the current directory, so each search gets a directory of its own
+	string tmp = (config.tmp_dir.empty() ? string("/tmp") : config.tmp_dir) + "/mempack_XXXXXX";
+	vector<char> name(tmp.begin(), tmp.end());
+	name.push_back('\0');
+	if (!mkdtemp(&name[0])){
+		message = "Couldn't create a temporary directory in " + tmp.substr(0, tmp.rfind('/'));
+		return false;
+	}
+	string dir = &name[0];
+
+	// The database path may be relative to where we were started
+	string database = config.database;
+	for (unsigned int i = 0; db_extensions[i]; i++){
+		if (!access((database + db_extensions[i]).c_str(), F_OK)){
+			database = absolute_path(database);
+			break;
+		}
+	}
+	string ncbidir = absolute_path(config.ncbidir);
+
+	ostringstream blast;
+	blast << "cd " << shell_quote(dir) << " && " << shell_quote(ncbidir + "/blastpgp") << " -a " << (cores ? cores : 1)
+	      << " -j 2 -h 1e-3 -e 1e-3 -b 0 -d " << shell_quote(database)
+	      << " -i mempack_tmp.fasta -C mempack_tmp.chk > mempack_tmp.out 2>&1";
+	string makemat = "cd " + shell_quote(dir) + " && " + shell_quote(ncbidir + "/makemat") + " -P mempack_tmp > /dev/null 2>&1";
+
+	bool ok = false;
+	if (!write_text(dir + "/mempack_tmp.fasta", ">query\n" + sequence + "\n")){
+		message = "Couldn't write to " + dir;
+	}else if (system(blast.str().c_str()) == -1 || access((dir + "/mempack_tmp.chk").c_str(), F_OK)){
+		message = "There was an error running PSI-BLAST on " + fasta + ". Did you set the database path correctly?";
+		ifstream err((dir + "/mempack_tmp.out").c_str());
+		string line;
+		while (getline(err, line)) message += "\n" + line;
+	}else if (!write_text(dir + "/mempack_tmp.pn", "mempack_tmp.chk\n") || !write_text(dir + "/mempack_tmp.sn", "mempack_tmp.fasta\n")
+	          || !run_command(makemat) || access((dir + "/mempack_tmp.mtx").c_str(), F_OK)){
+		message = "There was an error running makemat on " + fasta;
+	}else if (!install_file(dir + "/mempack_tmp.mtx", mtx_out)){
+		message = "Couldn't write to " + mtx_out;
+	}else{
+		// A cache that can't be written to only costs a repeat search
+		if (!cache_file.empty()) install_file(dir + "/mempack_tmp.mtx", cache_file);
+		ok = true;
+	}
+
+	remove_dir(dir);
+	return(ok);
+}
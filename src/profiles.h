@@ -0,0 +1,54 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: PSI-BLAST profile generation (run_psiblast in
+// run_mempack.pl). Every search runs in its own temporary directory
+// so any number can run at once, and finished .mtx files are kept in
+// an on-disk cache keyed by a hash of the sequence and the identity
+// of the database it was searched against.
+//
+
+#ifndef PROFILES_H
+#define PROFILES_H
+
+#include <string>
+
+using namespace std;
+
+struct search_config {
+
+	// Directory holding blastpgp and makemat
+	string ncbidir;
+	string database;
+
+	// Cache directory, no caching if empty
+	string cache_dir;
+
+	// Parent of the per-search temporary directories
+	string tmp_dir;
+};
+
+// Sequence of a fasta file, false if it has none
+bool read_fasta(const string& fasta, string& sequence);
+
+// Database name, size and modification time of its index files. A
+// rebuilt database gets a new identity and misses the cache.
+string database_identity(const string& database);
+
+// Write the .mtx profile for fasta to mtx_out, from the cache if
+// possible, otherwise by running blastpgp on cores cores followed by
+// makemat. cached is set on a cache hit; on failure message says why.
+bool make_profile(const search_config& config, const string& fasta, const string& mtx_out, unsigned int cores, bool& cached, string& message);
+
+#endif
@@ -0,0 +1,200 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Cache of optimised helix rotations, so a rerun on the
+// same protein can start its rotation search from the previous best.
+// The file holds one line per arrangement: its key followed by the
+// rotation of each helix.
+//
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <mutex>
+#include "globals.h"
+#include "rotation_cache.h"
+
+using namespace std;
+
+string hash_key(const string& text){
+
+	unsigned long long h = 14695981039346656037ULL;
+	for (unsigned int i = 0; i < text.size(); i++){
+		h ^= (unsigned char)text[i];
+		h *= 1099511628211ULL;
+	}
+	char hex[17];
+	sprintf(hex, "%016llx", h);
+	return(string(hex));
+}
+
+string arrangement_key(const layout_context& ctx, int x){
+
+	ostringstream text;
+	text << ctx.total;
+	for (unsigned int i = 0; i < ctx.boundaries.size(); i++) text << " " << ctx.boundaries[i];
+	text << "\n";
+
+	// Positions are rounded so that last-digit noise still hits
+	char position[64];
+	for (unsigned int h = 0; h < ctx.total; h++){
+		sprintf(position, "%.3f,%.3f ", ctx.all_helix_positions[x].x[h], ctx.all_helix_positions[x].y[h]);
+		text << position;
+	}
+	text << "\n";
+	for (unsigned int c = 0; c < ctx.contacts.size(); c++) text << ctx.contacts[c].first << "," << ctx.contacts[c].second << " ";
+	return(hash_key(text.str()));
+}
+
+void load_rotation_cache(const string& file, rotation_cache& cache){
+
+	ifstream is(file.c_str());
+	string line;
+	while (getline(is, line)){
+		istringstream fields(line);
+		string key;
+		int rotation;
+		vector<int> rotations;
+		if (!(fields >> key)) continue;
+		while (fields >> rotation) rotations.push_back(rotation);
+		if (!rotations.empty()) cache[key] = rotations;
+	}
+}
+
+bool replace_file(const string& file, const string& contents){
+
+	string tmp = file + ".XXXXXX";
+	vector<char> name(tmp.begin(), tmp.end());
+	name.push_back('\0');
+	int fd = mkstemp(&name[0]);
+	if (fd == -1) return false;
+	fchmod(fd, 0644);
+	close(fd);
+
+	ofstream os(&name[0]);
+	os << contents;
+	os.close();
+	if (!os.good() || rename(&name[0], file.c_str())){
+		remove(&name[0]);
+		return false;
+	}
+	return true;
+}
+
+bool save_rotation_cache(const string& file, const rotation_cache& cache){
+
+	ostringstream os;
+	for (rotation_cache::const_iterator it = cache.begin(); it != cache.end(); it++){
+		os << it->first;
+		for (unsigned int i = 0; i < it->second.size(); i++) os << " " << it->second[i];
+		os << "\n";
+	}
+	return(replace_file(file, os.str()));
+}
+
+int lock_cache_file(const string& file){
+
+	string lock_file = file + ".lock";
+	int fd = open(lock_file.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd == -1) return -1;
+	if (flock(fd, LOCK_EX)){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void unlock_cache_file(int fd){
+
+	close(fd);
+}
+
+// Entries of each file as read on its first use or last flush, and
+// the entries added since
+struct rotation_files {
+	mutex m;
+	map<string,rotation_cache> entries, added;
+};
+
+static rotation_files& rotation_store(){
+
+	static rotation_files store;
+	return store;
+}
+
+// With the store locked
+static rotation_cache& loaded(rotation_files& store, const string& file){
+
+	map<string,rotation_cache>::iterator it = store.entries.find(file);
+	if (it == store.entries.end()){
+		it = store.entries.insert(make_pair(file, rotation_cache())).first;
+		load_rotation_cache(file, it->second);
+	}
+	return(it->second);
+}
+
+bool cached_rotations(const string& file, const string& key, vector<int>& rotations){
+
+	rotation_files& store = rotation_store();
+	lock_guard<mutex> lock(store.m);
+	rotation_cache& cache = loaded(store, file);
+	rotation_cache::const_iterator hit = cache.find(key);
+	if (hit == cache.end()) return false;
+	rotations = hit->second;
+	return true;
+}
+
+void cache_rotations(const string& file, const rotation_cache& entries){
+
+	rotation_files& store = rotation_store();
+	lock_guard<mutex> lock(store.m);
+	rotation_cache& cache = loaded(store, file);
+	rotation_cache& added = store.added[file];
+	for (rotation_cache::const_iterator it = entries.begin(); it != entries.end(); it++){
+		cache[it->first] = it->second;
+		added[it->first] = it->second;
+	}
+}
+
+bool flush_rotation_caches(vector<string>& failed){
+
+	rotation_files& store = rotation_store();
+	lock_guard<mutex> lock(store.m);
+	bool ok = true;
+	map<string,rotation_cache>::iterator it = store.added.begin();
+	while (it != store.added.end()){
+		int fd = lock_cache_file(it->first);
+		rotation_cache merged;
+		load_rotation_cache(it->first, merged);
+		for (rotation_cache::const_iterator entry = it->second.begin(); entry != it->second.end(); entry++){
+			merged[entry->first] = entry->second;
+		}
+		bool saved = fd != -1 && save_rotation_cache(it->first, merged);
+		if (fd != -1) unlock_cache_file(fd);
+		if (!saved){
+			failed.push_back(it->first);
+			ok = false;
+			it++;
+			continue;
+		}
+		store.entries[it->first].swap(merged);
+		store.added.erase(it++);
+	}
+	return(ok);
+}
@@ -0,0 +1,67 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Cache of optimised helix rotations, so a rerun on the
+// same protein can start its rotation search from the previous best.
+// Entries are keyed by a hash of the arrangement: helix boundaries,
+// helix positions and contacts.
+//
+
+#ifndef ROTATION_CACHE_H
+#define ROTATION_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "globals.h"
+
+using namespace std;
+
+typedef map<string,vector<int> > rotation_cache;
+
+// 64 bit FNV-1a hash of text, in hex
+string hash_key(const string& text);
+
+// Key of arrangement x of the current component of a layout
+string arrangement_key(const layout_context& ctx, int x);
+
+// A missing file is an empty cache
+void load_rotation_cache(const string& file, rotation_cache& cache);
+
+// Written through a temporary file and renamed into place, so a
+// concurrent reader never sees half a cache. Returns false if the
+// file couldn't be written.
+bool save_rotation_cache(const string& file, const rotation_cache& cache);
+
+// Writes contents to file the same way
+bool replace_file(const string& file, const string& contents);
+
+// Takes the lock of a cache file, held by every process writing it,
+// waiting for it if need be. Returns the descriptor to unlock with,
+// or -1 if the lock can't be taken.
+int lock_cache_file(const string& file);
+void unlock_cache_file(int fd);
+
+// The rotation caches of the process, by file. A file is read on its
+// first use and its entries then shared by every layout of the process;
+// the entries added are kept until flush_rotation_caches.
+bool cached_rotations(const string& file, const string& key, vector<int>& rotations);
+void cache_rotations(const string& file, const rotation_cache& entries);
+
+// Writes the entries added to each file, merged under its lock with
+// what other processes have written to it since. Files that couldn't
+// be written are returned in failed and keep their entries.
+bool flush_rotation_caches(vector<string>& failed);
+
+#endif
@@ -0,0 +1,241 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Exact helix rotation optimiser. Rotations are
+// restricted to a number of equally spaced angle bins and the total
+// contact distance is minimised by variable elimination over the
+// helix contact graph.
+//
+// Every contact depends on the rotation of at most two helices, so
+// the cost is a sum of one- and two-helix tables. Eliminating a helix
+// replaces the tables that mention it by one table over its
+// neighbours holding the minimum over its bins. The work grows as
+// bins^(width+1), where width is the tree width of the elimination
+// order, which is small for the sparse contact graphs of helix
+// bundles.
+//
+
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+#include "globals.h"
+#include "draw_graphs.h"
+#include "rotation_dp.h"
+
+using namespace std;
+
+// Most bins^(width+1) cost sums an optimisation may take, which also
+// bounds the largest table, bins^width entries, to DP_MAX_WORK/bins
+#define DP_MAX_WORK (1ULL << 26)
+
+struct cost_table {
+	vector<int> vars;
+	vector<double> cost;
+};
+
+struct elimination {
+	int var;
+	vector<int> scope;
+	vector<short> best_bin;
+};
+
+// Greedy minimum degree elimination order, returns the tree width
+static int elimination_order(int helices, const vector<set<int> >& neighbours, vector<int>& order){
+
+	vector<set<int> > graph = neighbours;
+	vector<bool> done(helices, false);
+	int width = 0;
+
+	for (int step = 0; step < helices; step++){
+		int v = -1;
+		for (int h = 0; h < helices; h++){
+			if (!done[h] && (v < 0 || graph[h].size() < graph[v].size())) v = h;
+		}
+		width = max(width, (int)graph[v].size());
+		order.push_back(v);
+		done[v] = true;
+
+		// Neighbours of v become a clique
+		for (set<int>::iterator a = graph[v].begin(); a != graph[v].end(); a++){
+			graph[*a].erase(v);
+			for (set<int>::iterator b = graph[v].begin(); b != graph[v].end(); b++){
+				if (*a != *b) graph[*a].insert(*b);
+			}
+		}
+		graph[v].clear();
+	}
+	return(width);
+}
+
+// bins^exponent, false if it is above limit
+static bool power_within(int bins, int exponent, unsigned long long limit, unsigned long long& power){
+
+	power = 1;
+	for (int i = 0; i < exponent; i++){
+		if (power > limit / bins) return false;
+		power *= bins;
+	}
+	return true;
+}
+
+static size_t table_index(const vector<int>& vars, const vector<int>& bin, int bins){
+
+	size_t index = 0;
+	for (int i = vars.size()-1; i >= 0; i--) index = index*bins + bin[vars[i]];
+	return(index);
+}
+
+bool optimise_rotation_dp(const rotation_tables& geometry, int helices, int bins, int max_width, int* rotations, int& width, long& evaluations){
+
+	if (bins < 1) bins = 1;
+	if (bins > 360) bins = 360;
+	evaluations = 0;
+
+	// Which helices each contact depends on
+	vector<set<int> > neighbours(helices);
+	map<pair<int,int>,vector<unsigned int> > pair_contacts;
+	vector<vector<unsigned int> > single_contacts(helices);
+	const vector<pair<int,int> >& contacts = geometry.contacts;
+	for (unsigned int c = 0; c < contacts.size(); c++){
+		int h1 = residue_helix(geometry, contacts[c].first);
+		int h2 = residue_helix(geometry, contacts[c].second);
+		if (h1 >= helices) h1 = -1;
+		if (h2 >= helices) h2 = -1;
+		if (h1 > h2) swap(h1, h2);
+		if (h2 < 0) continue;
+		if (h1 < 0 || h1 == h2){
+			single_contacts[h2].push_back(c);
+		}else{
+			pair_contacts[make_pair(h1,h2)].push_back(c);
+			neighbours[h1].insert(h2);
+			neighbours[h2].insert(h1);
+		}
+	}
+
+	vector<int> order;
+	width = elimination_order(helices, neighbours, order);
+	if (width > max_width) return false;
+
+	// Checked before any table is allocated, no table can be larger
+	unsigned long long work;
+	if (!power_within(bins, width+1, DP_MAX_WORK, work)) return false;
+
+	vector<int> bin_rotation(bins);
+	for (int b = 0; b < bins; b++) bin_rotation[b] = b*360/bins;
+	vector<int> rot(rotations, rotations + helices);
+
+	// One- and two-helix cost tables
+	vector<cost_table> tables;
+	for (int h = 0; h < helices; h++){
+		if (single_contacts[h].empty()) continue;
+		cost_table t;
+		t.vars.push_back(h);
+		t.cost.assign(bins, 0.0);
+		for (int b = 0; b < bins; b++){
+			rot[h] = bin_rotation[b];
+			for (unsigned int k = 0; k < single_contacts[h].size(); k++){
+				t.cost[b] += contact_distance(geometry, single_contacts[h][k], &rot[0]);
+			}
+			evaluations++;
+		}
+		tables.push_back(t);
+	}
+	for (map<pair<int,int>,vector<unsigned int> >::iterator it = pair_contacts.begin(); it != pair_contacts.end(); it++){
+		int h1 = it->first.first;
+		int h2 = it->first.second;
+		cost_table t;
+		t.vars.push_back(h1);
+		t.vars.push_back(h2);
+		t.cost.assign((size_t)bins*bins, 0.0);
+		for (int b2 = 0; b2 < bins; b2++){
+			rot[h2] = bin_rotation[b2];
+			for (int b1 = 0; b1 < bins; b1++){
+				rot[h1] = bin_rotation[b1];
+				double sum = 0;
+				for (unsigned int k = 0; k < it->second.size(); k++){
+					sum += contact_distance(geometry, it->second[k], &rot[0]);
+				}
+				t.cost[(size_t)b2*bins + b1] = sum;
+				evaluations++;
+			}
+		}
+		tables.push_back(t);
+	}
+
+	// Eliminate the helices one at a time
+	vector<elimination> eliminated;
+	vector<int> bin(helices, 0);
+	for (unsigned int step = 0; step < order.size(); step++){
+		int v = order[step];
+
+		vector<cost_table> with_v, rest;
+		set<int> scope_set;
+		for (unsigned int t = 0; t < tables.size(); t++){
+			if (find(tables[t].vars.begin(), tables[t].vars.end(), v) == tables[t].vars.end()){
+				rest.push_back(tables[t]);
+				continue;
+			}
+			for (unsigned int i = 0; i < tables[t].vars.size(); i++){
+				if (tables[t].vars[i] != v) scope_set.insert(tables[t].vars[i]);
+			}
+			with_v.push_back(tables[t]);
+		}
+
+		elimination e;
+		e.var = v;
+		e.scope.assign(scope_set.begin(), scope_set.end());
+		cost_table reduced;
+		reduced.vars = e.scope;
+		unsigned long long entries;
+		power_within(bins, e.scope.size(), DP_MAX_WORK, entries);
+		size_t size = entries;
+		reduced.cost.assign(size, 0.0);
+		e.best_bin.assign(size, 0);
+
+		// Odometer over the bins of the scope, scope[0] fastest
+		for (unsigned int i = 0; i < e.scope.size(); i++) bin[e.scope[i]] = 0;
+		for (size_t index = 0; index < size; index++){
+			double min_cost = 0;
+			for (int b = 0; b < bins; b++){
+				bin[v] = b;
+				double sum = 0;
+				for (unsigned int t = 0; t < with_v.size(); t++){
+					sum += with_v[t].cost[table_index(with_v[t].vars, bin, bins)];
+				}
+				if (b == 0 || sum < min_cost){
+					min_cost = sum;
+					e.best_bin[index] = b;
+				}
+			}
+			reduced.cost[index] = min_cost;
+			for (unsigned int i = 0; i < e.scope.size(); i++){
+				if (++bin[e.scope[i]] < bins) break;
+				bin[e.scope[i]] = 0;
+			}
+		}
+
+		rest.push_back(reduced);
+		tables.swap(rest);
+		eliminated.push_back(e);
+	}
+
+	// Read the optimum back in reverse elimination order
+	for (int step = eliminated.size()-1; step >= 0; step--){
+		const elimination& e = eliminated[step];
+		bin[e.var] = e.best_bin[table_index(e.scope, bin, bins)];
+	}
+	for (int h = 0; h < helices; h++) rotations[h] = bin_rotation[bin[h]];
+	return true;
+}
@@ -0,0 +1,34 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Exact helix rotation optimiser. Rotations are
+// restricted to a number of equally spaced angle bins and the total
+// contact distance is minimised by variable elimination over the
+// helix contact graph.
+//
+
+#ifndef ROTATION_DP_H
+#define ROTATION_DP_H
+
+#include "draw_graphs.h"
+
+// Finds the rotations of the first helices helices, each a multiple
+// of 360/bins degrees, with the lowest total contact distance of the
+// arrangement geometry was prepared for. width is set to
+// the tree width of the elimination order; if it exceeds max_width,
+// or bins^(width+1) is too large to work through, nothing is
+// optimised and false is returned.
+bool optimise_rotation_dp(const rotation_tables& geometry, int helices, int bins, int max_width, int* rotations, int& width, long& evaluations);
+
+#endif
@@ -0,0 +1,202 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Dependency driven stage scheduler. Each stage of each
+// protein is a task with named inputs and outputs; a task becomes
+// ready once every input has been produced. Ready tasks from
+// different proteins run side by side under a global core budget,
+// and tasks that can use several cores get whatever is free.
+//
+
+#include <iostream>
+#include <algorithm>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "scheduler.h"
+
+using namespace std;
+
+static double now(){
+
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return(tv.tv_sec + tv.tv_usec/1e6);
+}
+
+// CPU time of the process and the children it has waited for, such as
+// the PSI-BLAST searches, which use the cores their lanes hold
+static double cpu_time(){
+
+	struct rusage self, children;
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children);
+	return(self.ru_utime.tv_sec + self.ru_utime.tv_usec/1e6 + self.ru_stime.tv_sec + self.ru_stime.tv_usec/1e6 +
+	       children.ru_utime.tv_sec + children.ru_utime.tv_usec/1e6 + children.ru_stime.tv_sec + children.ru_stime.tv_usec/1e6);
+}
+
+stage_scheduler::stage_scheduler(unsigned int cores) : budget(cores ? cores : 1), used(0), finished(0), failed(0), queue(NULL){
+}
+
+void stage_scheduler::add(const stage_task& task){
+
+	task_state state;
+	state.task = task;
+	state.waiting = 0;
+	state.started = state.done = state.failed = false;
+	state.lanes = state.lanes_left = 0;
+	state.lane_failed = false;
+	state.lane_seconds = 0;
+	if (!state.task.cores) state.task.cores = 1;
+
+	for (unsigned int i = 0; i < task.outputs.size(); i++){
+		producer[task.outputs[i]] = tasks.size();
+	}
+	tasks.push_back(state);
+}
+
+unsigned int stage_scheduler::run(){
+
+	// Wire up the graph; an input nobody produces can never be ready
+	for (unsigned int t = 0; t < tasks.size(); t++){
+		const vector<string>& inputs = tasks[t].task.inputs;
+		for (unsigned int i = 0; i < inputs.size(); i++){
+			map<string,unsigned int>::iterator it = producer.find(inputs[i]);
+			if (it == producer.end()){
+				cerr << "No stage produces " << inputs[i] << " needed by " << tasks[t].task.name << endl;
+				tasks[t].failed = true;
+			}else{
+				tasks[it->second].dependents.push_back(t);
+				tasks[t].waiting++;
+			}
+		}
+	}
+
+	double start = now(), cpu_start = cpu_time();
+	{
+		work_queue pool(budget);
+		queue = &pool;
+
+		unique_lock<mutex> lock(m);
+		for (unsigned int t = 0; t < tasks.size(); t++){
+			if (tasks[t].failed && !tasks[t].done){
+				complete(t, false);
+			}else if (!tasks[t].waiting && !tasks[t].done){
+				ready.insert(make_pair(-tasks[t].task.priority, t));
+			}
+		}
+		dispatch();
+		done_cv.wait(lock, [this]{ return finished == tasks.size(); });
+		lock.unlock();
+
+		pool.wait();
+		queue = NULL;
+	}
+	double elapsed = now() - start, cpu = cpu_time() - cpu_start;
+
+	cout << endl << "Stage\t\tTasks\tCore-seconds" << endl;
+	for (map<string,stage_stats>::iterator it = stats.begin(); it != stats.end(); it++){
+		cout << it->first << "\t\t" << it->second.tasks << "\t" << it->second.core_seconds << endl;
+	}
+	if (elapsed > 0){
+		cout << "Core utilisation: " << (int)(100.0 * cpu / (elapsed * budget)) << "% of " << budget << " cores" << endl;
+	}
+	return(failed);
+}
+
+// Called with m held: start the most urgent ready tasks until the
+// core budget is used up
+void stage_scheduler::dispatch(){
+
+	while (used < budget && !ready.empty()){
+		unsigned int t = ready.begin()->second;
+		ready.erase(ready.begin());
+
+		task_state& state = tasks[t];
+		if (state.done) continue;
+		state.started = true;
+		state.lanes = min(state.task.cores, budget - used);
+		state.lanes_left = state.lanes;
+		used += state.lanes;
+
+		for (unsigned int lane = 0; lane < state.lanes; lane++){
+			unsigned int lanes = state.lanes;
+			queue->push([this, t, lane, lanes](){
+				double start = now();
+				bool ok = tasks[t].task.run(lane, lanes);
+				lane_done(t, ok, now() - start);
+			});
+		}
+	}
+
+	// Nothing running and nothing ready: what is left waits on a cycle
+	if (!used && finished < tasks.size()){
+		for (unsigned int t = 0; t < tasks.size(); t++){
+			if (!tasks[t].done){
+				cerr << "Skipping " << tasks[t].task.name << ", its inputs can never be produced." << endl;
+				complete(t, false);
+			}
+		}
+	}
+}
+
+void stage_scheduler::lane_done(unsigned int t, bool ok, double seconds){
+
+	task_state& state = tasks[t];
+	bool last;
+	{
+		lock_guard<mutex> lock(m);
+		if (!ok) state.lane_failed = true;
+		state.lane_seconds += seconds;
+		last = !--state.lanes_left;
+	}
+	if (!last) return;
+
+	ok = !state.lane_failed;
+	double start = now();
+	if (ok && state.task.finish) ok = state.task.finish();
+	seconds = now() - start;
+
+	lock_guard<mutex> lock(m);
+	stats[state.task.stage].tasks++;
+	stats[state.task.stage].core_seconds += state.lane_seconds + seconds;
+	used -= state.lanes;
+	complete(t, ok);
+	dispatch();
+}
+
+// Called with m held
+void stage_scheduler::complete(unsigned int t, bool ok){
+
+	task_state& state = tasks[t];
+	state.done = true;
+	finished++;
+
+	if (!ok){
+		failed++;
+		// Nothing downstream of a failed stage can run
+		for (unsigned int d = 0; d < state.dependents.size(); d++){
+			unsigned int dep = state.dependents[d];
+			if (!tasks[dep].done){
+				cerr << "Skipping " << tasks[dep].task.name << ", " << state.task.name << " failed." << endl;
+				complete(dep, false);
+			}
+		}
+	}else{
+		for (unsigned int d = 0; d < state.dependents.size(); d++){
+			task_state& dep = tasks[state.dependents[d]];
+			if (!--dep.waiting && !dep.done) ready.insert(make_pair(-dep.task.priority, state.dependents[d]));
+		}
+	}
+	if (finished == tasks.size()) done_cv.notify_all();
+}
@@ -0,0 +1,107 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Dependency driven stage scheduler. Each stage of each
+// protein is a task with named inputs and outputs; a task becomes
+// ready once every input has been produced. Ready tasks from
+// different proteins run side by side under a global core budget,
+// and tasks that can use several cores get whatever is free.
+//
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "work_queue.h"
+
+using namespace std;
+
+struct stage_task {
+
+	string name;
+	string stage;
+	vector<string> inputs;
+	vector<string> outputs;
+
+	// Higher runs first when several tasks are ready
+	double priority;
+
+	// Upper limit on cores; the task is started with at least one
+	unsigned int cores;
+
+	// Called once per granted core with (lane, lanes). The task has
+	// failed if any lane returns false.
+	function<bool(unsigned int, unsigned int)> run;
+
+	// Optional, called once after the last lane has returned
+	function<bool()> finish;
+};
+
+class stage_scheduler {
+
+public:
+	stage_scheduler(unsigned int cores);
+
+	void add(const stage_task& task);
+
+	// Run every task whose inputs can be produced. Returns the number
+	// of tasks that failed or were skipped because an input failed.
+	unsigned int run();
+
+	unsigned int cores() const { return budget; }
+
+private:
+	struct task_state {
+		stage_task task;
+		unsigned int waiting;
+		vector<unsigned int> dependents;
+		bool started, done, failed;
+		unsigned int lanes, lanes_left;
+		bool lane_failed;
+
+		// Wall time the lanes have spent running so far
+		double lane_seconds;
+	};
+
+	void dispatch();
+	void lane_done(unsigned int t, bool ok, double seconds);
+	void complete(unsigned int t, bool ok);
+
+	unsigned int budget, used;
+	vector<task_state> tasks;
+	map<string,unsigned int> producer;
+
+	// Ready tasks, most urgent first
+	set<pair<double,unsigned int> > ready;
+	mutex m;
+	condition_variable done_cv;
+	unsigned int finished, failed;
+	work_queue* queue;
+
+	// Core-seconds are the time the lanes of the stage's tasks spent
+	// running, not the time their cores were held
+	struct stage_stats {
+		unsigned int tasks;
+		double core_seconds;
+	};
+	map<string,stage_stats> stats;
+};
+
+#endif
@@ -0,0 +1,197 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Stress majorisation (SMACOF) layout. It minimises the
+// same spring energy as Kamada-Kawai, but moves every vertex at once
+// to the minimum of a quadratic bound on the energy, so the energy
+// falls at every iteration.
+//
+// With spring lengths l and strengths w, each iteration solves
+// L x' = B(x) x for x and y, where L is the Laplacian of w and
+// B(x) has w l / |xi - xj| off the diagonal. L doesn't change, so it
+// is factorised once and an iteration costs two O(n^2) passes.
+//
+
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "kk_layout.h"
+#include "stress_layout.h"
+
+using namespace std;
+
+// Cholesky factorisation in place of the n by n matrix a, lower triangle
+static void cholesky(vector<double>& a, unsigned int n){
+
+	for (unsigned int j = 0; j < n; j++){
+		double d = a[j*n + j];
+		for (unsigned int k = 0; k < j; k++) d -= a[j*n + k] * a[j*n + k];
+		d = sqrt(d);
+		a[j*n + j] = d;
+		for (unsigned int i = j+1; i < n; i++){
+			double s = a[i*n + j];
+			for (unsigned int k = 0; k < j; k++) s -= a[i*n + k] * a[j*n + k];
+			a[i*n + j] = s / d;
+		}
+	}
+}
+
+// Solve a a^T x = b in place, a from cholesky
+static void cholesky_solve(const vector<double>& a, unsigned int n, double* b){
+
+	for (unsigned int i = 0; i < n; i++){
+		double s = b[i];
+		for (unsigned int k = 0; k < i; k++) s -= a[i*n + k] * b[k];
+		b[i] = s / a[i*n + i];
+	}
+	for (int i = n-1; i >= 0; i--){
+		double s = b[i];
+		for (unsigned int k = i+1; k < n; k++) s -= a[k*n + i] * b[k];
+		b[i] = s / a[i*n + i];
+	}
+}
+
+// Row i of B(x) x, and the energy of the springs of vertex i. Rows are
+// stride long, padding has zero strength.
+static void majorise_row(const double* x, const double* y, const double* length, const double* weight, unsigned int i, unsigned int stride, double& bx, double& by, double& energy){
+
+#ifdef __SSE2__
+	__m128d zero = _mm_setzero_pd();
+	__m128d xi = _mm_set1_pd(x[i]);
+	__m128d yi = _mm_set1_pd(y[i]);
+	__m128d sx = zero, sy = zero, se = zero;
+	for (unsigned int j = 0; j < stride; j += 2){
+		__m128d x_diff = _mm_sub_pd(xi, _mm_loadu_pd(x+j));
+		__m128d y_diff = _mm_sub_pd(yi, _mm_loadu_pd(y+j));
+		__m128d dist = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(x_diff, x_diff), _mm_mul_pd(y_diff, y_diff)));
+		__m128d l = _mm_loadu_pd(length+j);
+		__m128d w = _mm_loadu_pd(weight+j);
+
+		// i itself, or a vertex on top of it, pulls neither way
+		__m128d apart = _mm_cmpneq_pd(dist, zero);
+		__m128d b = _mm_and_pd(apart, _mm_div_pd(_mm_mul_pd(w, l), dist));
+		sx = _mm_add_pd(sx, _mm_mul_pd(b, x_diff));
+		sy = _mm_add_pd(sy, _mm_mul_pd(b, y_diff));
+		__m128d stretch = _mm_sub_pd(dist, l);
+		se = _mm_add_pd(se, _mm_mul_pd(w, _mm_mul_pd(stretch, stretch)));
+	}
+	double a[2];
+	_mm_storeu_pd(a, sx);
+	bx = a[0] + a[1];
+	_mm_storeu_pd(a, sy);
+	by = a[0] + a[1];
+	_mm_storeu_pd(a, se);
+	energy = a[0] + a[1];
+#else
+	bx = by = energy = 0;
+	for (unsigned int j = 0; j < stride; j++){
+		double x_diff = x[i] - x[j];
+		double y_diff = y[i] - y[j];
+		double dist = sqrt(x_diff * x_diff + y_diff * y_diff);
+		if (dist > 0){
+			double b = weight[j] * length[j] / dist;
+			bx += b * x_diff;
+			by += b * y_diff;
+		}
+		energy += weight[j] * (dist - length[j]) * (dist - length[j]);
+	}
+#endif
+}
+
+bool stress_majorisation_layout(unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, double edge_length, double* x, double* y,
+                                double tolerance, int max_iterations, int& iterations, double& energy){
+
+	iterations = 0;
+	energy = 0;
+	unsigned int n = vertices;
+	vector<double> d;
+	if (!graph_distances(n, edges, edge_weight, d)) return false;
+	if (n < 2) return true;
+
+	// Same lengths and strengths as the Kamada-Kawai springs
+	unsigned int stride = (n + 1) & ~1u;
+	vector<double> length(n*stride, 0.0), weight(n*stride, 0.0);
+	double collapsed = 0;
+	for (unsigned int i = 0; i < n; i++){
+		for (unsigned int j = 0; j < n; j++){
+			if (i == j) continue;
+			length[i*stride + j] = edge_length * d[i*n + j];
+			weight[i*stride + j] = 1.0 / (d[i*n + j] * d[i*n + j]);
+			collapsed += 0.25 * edge_length * edge_length;
+		}
+	}
+
+	// L is singular, moving every vertex by the same amount changes
+	// nothing. L + 1/n isn't, and gives the same solution for the right
+	// hand sides B(x) x, whose x and y each add up to zero.
+	vector<double> laplacian(n*n);
+	for (unsigned int i = 0; i < n; i++){
+		double sum = 0;
+		for (unsigned int j = 0; j < n; j++){
+			if (i == j) continue;
+			laplacian[i*n + j] = -weight[i*stride + j] + 1.0/n;
+			sum += weight[i*stride + j];
+		}
+		laplacian[i*n + i] = sum + 1.0/n;
+	}
+	cholesky(laplacian, n);
+
+	// The solution is centred on the origin, keep the layout where it was
+	double x_centre = 0, y_centre = 0;
+	vector<double> px(stride, 0.0), py(stride, 0.0);
+	for (unsigned int i = 0; i < n; i++){
+		px[i] = x[i];
+		py[i] = y[i];
+		x_centre += x[i]/n;
+		y_centre += y[i]/n;
+	}
+
+	vector<double> bx(n), by(n);
+	double last_energy = -1;
+	while (true){
+		energy = 0;
+		for (unsigned int i = 0; i < n; i++){
+			double e;
+			majorise_row(&px[0], &py[0], &length[i*stride], &weight[i*stride], i, stride, bx[i], by[i], e);
+			energy += e;
+		}
+
+		// Every spring was counted from both ends
+		energy /= 4;
+
+		// A graph that can be drawn with every spring at its length,
+		// a chain, approaches zero energy ever more slowly, so stop when
+		// the energy is negligible next to that of every vertex in one
+		// place
+		if (last_energy >= 0 && last_energy - energy <= tolerance * last_energy) break;
+		if (energy <= tolerance * collapsed) break;
+		if (iterations >= max_iterations) break;
+		last_energy = energy;
+
+		cholesky_solve(laplacian, n, &bx[0]);
+		cholesky_solve(laplacian, n, &by[0]);
+		for (unsigned int i = 0; i < n; i++){
+			px[i] = bx[i] + x_centre;
+			py[i] = by[i] + y_centre;
+		}
+		iterations++;
+	}
+
+	for (unsigned int i = 0; i < n; i++){
+		x[i] = px[i];
+		y[i] = py[i];
+	}
+	return true;
+}
@@ -0,0 +1,39 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Stress majorisation (SMACOF) layout. It minimises the
+// same spring energy as Kamada-Kawai, but moves every vertex at once
+// to the minimum of a quadratic bound on the energy, so the energy
+// falls at every iteration.
+//
+
+#ifndef STRESS_LAYOUT_H
+#define STRESS_LAYOUT_H
+
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+// Moves the vertices 0..vertices-1, starting from x and y, to a layout
+// of lowest spring energy with edge_length per unit of graph distance,
+// each edge being edge_weight long. Stops once an iteration lowers the
+// energy by less than tolerance of itself, or after max_iterations.
+// iterations and energy are set to the number made and the final
+// energy. Returns false and leaves the positions alone if the graph
+// isn't connected.
+bool stress_majorisation_layout(unsigned int vertices, const vector<pair<int,int> >& edges, double edge_weight, double edge_length, double* x, double* y,
+                                double tolerance, int max_iterations, int& iterations, double& energy);
+
+#endif
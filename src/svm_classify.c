@@ -21,10 +21,16 @@
 char docfile[200];
 char modelfile[200];
 char predictionsfile[200];
+char prefilterfile[200];       /* cheap first-stage model for cascade mode */
+double recall_target;          /* fraction of stage 2 positives to keep */
+long calib_interval;           /* every n-th example calibrates stage 1 */
 
 void read_input_parameters(int, char **, char *, char *, char *, long *, 
 			   long *);
 void print_help(void);
+double classify_words(MODEL *, WORD *, WORD *, char *);
+int distcmp_desc(const void *, const void *);
+double cascade_threshold(double *, double *, long, double);
 
 
 int main (int argc, char* argv[])
@@ -41,6 +47,11 @@ int main (int argc, char* argv[])
   char *line,*comment; 
   FILE *predfl,*docfl;
   MODEL *model; 
+  MODEL *prefilter=NULL;
+  WORD *scratch=NULL;
+  double *pre_dist=NULL,*full_dist=NULL;
+  double threshold=0;
+  long ndocs=0,ncalib=0,rejected=0,survived=0;
 
   read_input_parameters(argc,argv,docfile,modelfile,predictionsfile,
 			&verbosity,&pred_format);
@@ -58,6 +69,36 @@ int main (int argc, char* argv[])
     /* compute weight vector */
     add_weight_vector_to_linear_model(model);
   }
+
+  if(prefilterfile[0]) {
+    prefilter=read_model(prefilterfile);
+    if(prefilter->kernel_parm.kernel_type == 0) {
+      add_weight_vector_to_linear_model(prefilter);
+    }
+    scratch = (WORD *)my_malloc(sizeof(WORD)*(max_words_doc+10));
+
+    /* Stage 1 pass: score every example with the prefilter and every
+       calib_interval-th one with the full model as well. The
+       calibration sample fixes the prefilter threshold that keeps
+       recall_target of the full model's positives. */
+    pre_dist = (double *)my_malloc(sizeof(double)*(max_docs+1));
+    full_dist = (double *)my_malloc(sizeof(double)*(max_docs+1));
+    if ((docfl = fopen (docfile, "r")) == NULL)
+    { perror (docfile); exit (1); }
+    while((!feof(docfl)) && fgets(line,(int)lld,docfl)) {
+      if(line[0] == '#') continue;
+      parse_document(line,words,&doc_label,&queryid,&slackid,&costfactor,&wnum,
+		     max_words_doc,&comment);
+      pre_dist[ndocs]=classify_words(prefilter,words,scratch,comment);
+      if(ndocs % calib_interval == 0) {
+	full_dist[ndocs]=classify_words(model,words,scratch,comment);
+	ncalib++;
+      }
+      ndocs++;
+    }
+    fclose(docfl);
+    threshold=cascade_threshold(pre_dist,full_dist,ndocs,recall_target);
+  }
   
   if(verbosity>=2) {
     printf("Classifying test examples.."); fflush(stdout);
@@ -73,7 +114,23 @@ int main (int argc, char* argv[])
     parse_document(line,words,&doc_label,&queryid,&slackid,&costfactor,&wnum,
 		   max_words_doc,&comment);
     totdoc++;
-    if(model->kernel_parm.kernel_type == 0) {   /* linear kernel */
+    if(prefilter) {                    /* cascade mode */
+      if((totdoc-1) % calib_interval == 0) {
+	dist=full_dist[totdoc-1];
+      }
+      else if(pre_dist[totdoc-1] < threshold) {
+	/* rejected by stage 1, report as a non-contact */
+	dist=(pre_dist[totdoc-1] < 0) ? pre_dist[totdoc-1] : 0;
+	rejected++;
+      }
+      else {
+	t1=get_runtime();
+	dist=classify_words(model,words,scratch,comment);
+	runtime+=(get_runtime()-t1);
+	survived++;
+      }
+    }
+    else if(model->kernel_parm.kernel_type == 0) {   /* linear kernel */
       for(j=0;(words[j]).wnum != 0;j++) {  /* Check if feature numbers   */
 	if((words[j]).wnum>model->totwords) /* are not larger than in     */
 	  (words[j]).wnum=0;               /* model. Remove feature if   */
@@ -120,6 +177,20 @@ int main (int argc, char* argv[])
   free(words);
   free_model(model,1);
 
+  if(prefilter) {
+    if(verbosity>=1) {
+      printf("Cascade: %ld examples, recall target %.3f, stage 1 threshold %.8g\n",
+	     totdoc,recall_target,threshold);
+      printf("Cascade: stage 1 scored %ld, rejected %ld\n",totdoc,rejected);
+      printf("Cascade: stage 2 scored %ld (%ld calibration + %ld survivors)\n",
+	     ncalib+survived,ncalib,survived);
+    }
+    free(scratch);
+    free(pre_dist);
+    free(full_dist);
+    free_model(prefilter,1);
+  }
+
   if(verbosity>=2) {
     printf("done\n");
 
@@ -148,6 +219,9 @@ void read_input_parameters(int argc, char **argv, char *docfile,
   /* set default */
   strcpy (modelfile, "svm_model");
   strcpy (predictionsfile, "svm_predictions"); 
+  prefilterfile[0]=0;
+  recall_target=0.99;
+  calib_interval=10;
   (*verbosity)=2;
   (*pred_format)=1;
 
@@ -157,6 +231,9 @@ void read_input_parameters(int argc, char **argv, char *docfile,
       case 'h': print_help(); exit(0);
       case 'v': i++; (*verbosity)=atol(argv[i]); break;
       case 'f': i++; (*pred_format)=atol(argv[i]); break;
+      case 'p': i++; strcpy(prefilterfile,argv[i]); break;
+      case 'r': i++; recall_target=atof(argv[i]); break;
+      case 's': i++; calib_interval=atol(argv[i]); break;
       default: printf("\nUnrecognized option %s!\n\n",argv[i]);
 	       print_help();
 	       exit(0);
@@ -177,6 +254,70 @@ void read_input_parameters(int argc, char **argv, char *docfile,
     print_help();
     exit(0);
   }
+  if((recall_target <= 0) || (recall_target > 1)) {
+    printf("\nRecall target must be in the range (0,1]!\n\n");
+    print_help();
+    exit(0);
+  }
+  if(calib_interval < 1) {
+    printf("\nCalibration interval must be at least 1!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+double classify_words(MODEL *model, WORD *words, WORD *scratch, char *comment)
+     /* classifies a parsed example without modifying words */
+{
+  DOC *doc;
+  double dist;
+  long j;
+
+  for(j=0;(words[j]).wnum != 0;j++) {
+    scratch[j]=words[j];
+    if((model->kernel_parm.kernel_type == 0)    /* drop features the */
+       && ((words[j]).wnum>model->totwords))    /* linear model does */
+      break;                                    /* not know about    */
+  }
+  scratch[j].wnum=0;
+  doc = create_example(-1,0,0,0.0,create_svector(scratch,comment,1.0));
+  if(model->kernel_parm.kernel_type == 0)
+    dist=classify_example_linear(model,doc);
+  else
+    dist=classify_example(model,doc);
+  free_example(doc,1);
+  return(dist);
+}
+
+int distcmp_desc(const void *a, const void *b)
+{
+  if(*(double *)a > *(double *)b) return(-1);
+  if(*(double *)a < *(double *)b) return(1);
+  return(0);
+}
+
+double cascade_threshold(double *pre_dist, double *full_dist, long ndocs,
+			 double recall)
+     /* lowest prefilter score that keeps the requested fraction of the
+	full model's positives in the calibration sample */
+{
+  double *pos,tmp;
+  long i,npos=0,keep;
+
+  pos = (double *)my_malloc(sizeof(double)*(ndocs+1));
+  for(i=0;i<ndocs;i+=calib_interval) {
+    if(full_dist[i]>0) pos[npos++]=pre_dist[i];
+  }
+  if(!npos) {              /* nothing to calibrate on, reject nothing */
+    free(pos);
+    return(-DBL_MAX);
+  }
+  qsort(pos,npos,sizeof(double),distcmp_desc);
+  keep=(long)ceil(recall*npos);
+  if(keep<1) keep=1;
+  tmp=pos[keep-1];
+  free(pos);
+  return(tmp);
 }
 
 void print_help(void)
@@ -187,7 +328,12 @@ void print_help(void)
   printf("options: -h         -> this help\n");
   printf("         -v [0..3]  -> verbosity level (default 2)\n");
   printf("         -f [0,1]   -> 0: old output format of V1.0\n");
-  printf("                    -> 1: output the value of decision function (default)\n\n");
+  printf("                    -> 1: output the value of decision function (default)\n");
+  printf("         -p file    -> cascade mode: cheap prefilter model run first; only\n");
+  printf("                       examples it does not reject reach model_file\n");
+  printf("         -r float   -> cascade recall target for model_file positives (default 0.99)\n");
+  printf("         -s int     -> cascade calibration: score every s-th example with both\n");
+  printf("                       models to set the prefilter threshold (default 10)\n\n");
 }
 
 
@@ -0,0 +1,140 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_reduce.c                                                      */
+/*                                                                     */
+/*   Reduced-set model for the cascade mode of svm_classify. Keeps the */
+/*   support vectors of a model with the largest weights, so the       */
+/*   reduced model scores an example in a fraction of the time. It     */
+/*   only has to rank examples roughly like the full model: the        */
+/*   cascade sets its threshold from examples scored by both.          */
+/*                                                                     */
+/***********************************************************************/
+
+# include "svm_common.h"
+
+char modelfile[200];
+char outputfile[200];
+double keep_fraction;          /* share of the support vectors kept */
+long keep_count;               /* number kept, overrides keep_fraction */
+
+void read_input_parameters(int, char **);
+void print_help(void);
+int alphacmp_desc(const void *, const void *);
+
+MODEL *sorted_model;           /* model whose alphas alphacmp_desc reads */
+
+
+int main (int argc, char* argv[])
+{
+  MODEL *model;
+  SVECTOR *v;
+  FILE *modelfl;
+  long *order;
+  long i,j,sv,keep;
+
+  read_input_parameters(argc,argv);
+  model=read_model(modelfile);
+
+  sv=model->sv_num-1;
+  keep=keep_count ? keep_count : (long)ceil(keep_fraction*sv);
+  if(keep>sv) keep=sv;
+  if(keep<1) keep=1;
+
+  /* support vectors by falling |alpha| */
+  order = (long *)my_malloc(sizeof(long)*(sv+1));
+  for(i=0;i<sv;i++) order[i]=i+1;
+  sorted_model=model;
+  qsort(order,sv,sizeof(long),alphacmp_desc);
+
+  if ((modelfl = fopen (outputfile, "w")) == NULL)
+  { perror (outputfile); exit (1); }
+  fprintf(modelfl,"SVM-light Version %s\n",VERSION);
+  fprintf(modelfl,"%ld # kernel type\n",model->kernel_parm.kernel_type);
+  fprintf(modelfl,"%ld # kernel parameter -d \n",model->kernel_parm.poly_degree);
+  fprintf(modelfl,"%.8g # kernel parameter -g \n",model->kernel_parm.rbf_gamma);
+  fprintf(modelfl,"%.8g # kernel parameter -s \n",model->kernel_parm.coef_lin);
+  fprintf(modelfl,"%.8g # kernel parameter -r \n",model->kernel_parm.coef_const);
+  fprintf(modelfl,"%s# kernel parameter -u \n",model->kernel_parm.custom);
+  fprintf(modelfl,"%ld # highest feature index \n",model->totwords);
+  fprintf(modelfl,"%ld # number of training documents \n",model->totdoc);
+  fprintf(modelfl,"%ld # number of support vectors plus 1 \n",keep+1);
+  fprintf(modelfl,"%.8g # threshold b, each following line is a SV (starting with alpha*y)\n",model->b);
+  for(i=0;i<keep;i++) {
+    for(v=model->supvec[order[i]]->fvec;v;v=v->next) {
+      fprintf(modelfl,"%.32g ",model->alpha[order[i]]*v->factor);
+      for(j=0;(v->words[j]).wnum;j++) {
+	fprintf(modelfl,"%ld:%.8g ",(long)(v->words[j]).wnum,(double)(v->words[j]).weight);
+      }
+      if(v->userdefined)
+	fprintf(modelfl,"#%s\n",v->userdefined);
+      else
+	fprintf(modelfl,"#\n");
+    }
+  }
+  fclose(modelfl);
+
+  if(verbosity>=1) {
+    printf("Kept %ld of %ld support vectors\n",keep,sv);
+  }
+  free(order);
+  free_model(model,1);
+  return(0);
+}
+
+int alphacmp_desc(const void *a, const void *b)
+{
+  double x=fabs(sorted_model->alpha[*(long *)a]);
+  double y=fabs(sorted_model->alpha[*(long *)b]);
+  if(x > y) return(-1);
+  if(x < y) return(1);
+  /* equal weights keep the order of the model file */
+  if(*(long *)a < *(long *)b) return(-1);
+  if(*(long *)a > *(long *)b) return(1);
+  return(0);
+}
+
+void read_input_parameters(int argc, char **argv)
+{
+  long i;
+
+  /* set default */
+  keep_fraction=0.1;
+  keep_count=0;
+  verbosity=1;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1])
+      {
+      case 'h': print_help(); exit(0);
+      case 'v': i++; verbosity=atol(argv[i]); break;
+      case 'f': i++; keep_fraction=atof(argv[i]); break;
+      case 'n': i++; keep_count=atol(argv[i]); break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (modelfile, argv[i]);
+  strcpy (outputfile, argv[i+1]);
+  if((keep_fraction <= 0) || (keep_fraction > 1)) {
+    printf("\nFraction of support vectors kept must be in the range (0,1]!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help(void)
+{
+  printf("\nsvm_reduce: reduced-set prefilter model for svm_classify -p\n\n");
+  printf("   usage: svm_reduce [options] model_file output_file\n\n");
+  printf("options: -h         -> this help\n");
+  printf("         -v [0..3]  -> verbosity level (default 1)\n");
+  printf("         -f float   -> fraction of the support vectors kept, those with\n");
+  printf("                       the largest weights (default 0.1)\n");
+  printf("         -n int     -> number of support vectors kept, overrides -f\n\n");
+}
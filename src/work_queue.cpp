@@ -0,0 +1,134 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Thread pool with one task deque per worker. Workers
+// take their own newest task first and steal the oldest task of
+// another worker when they run out, so a large protein split into
+// many small tasks is shared out while small proteins keep flowing.
+//
+
+#include "work_queue.h"
+
+using namespace std;
+
+// Queue and index of the worker running on this thread. Queues can be
+// nested, a task of one pushing to another, so the index only counts
+// in its own queue.
+static thread_local const work_queue* owner = NULL;
+static thread_local int worker_id = -1;
+
+work_queue::work_queue(unsigned int threads) : queued(0), pending(0), next_deque(0), stopping(false){
+
+	if (!threads) threads = 1;
+	for (unsigned int i = 0; i < threads; i++){
+		deques.push_back(new worker_deque);
+	}
+	for (unsigned int i = 0; i < threads; i++){
+		workers.push_back(thread(&work_queue::run, this, i));
+	}
+}
+
+work_queue::~work_queue(){
+
+	{
+		lock_guard<mutex> lock(state_m);
+		stopping = true;
+	}
+	work_cv.notify_all();
+	for (unsigned int i = 0; i < workers.size(); i++){
+		workers[i].join();
+	}
+	for (unsigned int i = 0; i < deques.size(); i++){
+		delete deques[i];
+	}
+}
+
+void work_queue::push(const task& t){
+
+	unsigned int id;
+	{
+		lock_guard<mutex> lock(state_m);
+		id = owner == this ? worker_id : next_deque++ % deques.size();
+		pending++;
+	}
+	{
+		lock_guard<mutex> lock(deques[id]->m);
+		deques[id]->tasks.push_back(t);
+	}
+	{
+		lock_guard<mutex> lock(state_m);
+		queued++;
+	}
+	work_cv.notify_one();
+}
+
+bool work_queue::take(unsigned int id, task& t){
+
+	// Own deque: newest first, keeps a protein's data in cache
+	{
+		worker_deque* own = deques[id];
+		lock_guard<mutex> lock(own->m);
+		if (!own->tasks.empty()){
+			t = own->tasks.back();
+			own->tasks.pop_back();
+			return true;
+		}
+	}
+
+	// Steal the oldest task from the next non-empty deque
+	for (unsigned int i = 1; i < deques.size(); i++){
+		worker_deque* victim = deques[(id + i) % deques.size()];
+		lock_guard<mutex> lock(victim->m);
+		if (!victim->tasks.empty()){
+			t = victim->tasks.front();
+			victim->tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void work_queue::run(unsigned int id){
+
+	owner = this;
+	worker_id = id;
+
+	while (true){
+		{
+			unique_lock<mutex> lock(state_m);
+			work_cv.wait(lock, [this]{ return queued > 0 || stopping; });
+			if (!queued && stopping) return;
+			queued--;
+		}
+
+		// A task is reserved for this worker, it may just sit in
+		// another deque until the pusher has finished adding it
+		task t;
+		while (!take(id, t)){
+			this_thread::yield();
+		}
+		t();
+
+		{
+			lock_guard<mutex> lock(state_m);
+			if (!--pending) done_cv.notify_all();
+		}
+	}
+}
+
+void work_queue::wait(){
+
+	unique_lock<mutex> lock(state_m);
+	done_cv.wait(lock, [this]{ return pending == 0; });
+}
@@ -0,0 +1,68 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Thread pool with one task deque per worker. Workers
+// take their own newest task first and steal the oldest task of
+// another worker when they run out, so a large protein split into
+// many small tasks is shared out while small proteins keep flowing.
+//
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+using namespace std;
+
+class work_queue {
+
+public:
+	typedef function<void()> task;
+
+	work_queue(unsigned int threads);
+	~work_queue();
+
+	// Called from a worker of this queue the task goes on that worker's
+	// own deque, otherwise, even from a worker of another queue, the
+	// deques are filled round-robin
+	void push(const task& t);
+
+	// Block until every task, including tasks pushed by tasks, is done
+	void wait();
+
+	unsigned int size() const { return workers.size(); }
+
+private:
+	struct worker_deque {
+		mutex m;
+		deque<task> tasks;
+	};
+
+	bool take(unsigned int id, task& t);
+	void run(unsigned int id);
+
+	vector<worker_deque*> deques;
+	vector<thread> workers;
+	mutex state_m;
+	condition_variable work_cv, done_cv;
+	unsigned long queued, pending, next_deque;
+	bool stopping;
+};
+
+#endif
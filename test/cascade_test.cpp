@@ -0,0 +1,99 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Tests of the cascade mode of bin/svm_classify and of
+// the prefilter models bin/svm_reduce makes, with small linear models
+// whose scores are a single feature. Run by make test once both are
+// built.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char* test){
+
+	cout << (ok ? "ok      " : "FAILED  ") << test << endl;
+	if (!ok) failures++;
+}
+
+static void write_file(const string& file, const string& text){
+
+	ofstream os(file.c_str());
+	os << text;
+}
+
+static string read_file(const string& file){
+
+	ifstream is(file.c_str());
+	ostringstream text;
+	text << is.rdbuf();
+	return(text.str());
+}
+
+// A linear model whose support vectors are given one per line
+static string linear_model(int support_vectors, const string& lines){
+
+	ostringstream model;
+	model << "SVM-light Version V6.01\n0 # kernel type\n3 # kernel parameter -d \n1 # kernel parameter -g \n"
+	      << "1 # kernel parameter -s \n1 # kernel parameter -r \nempty# kernel parameter -u \n"
+	      << "2 # highest feature index \n" << support_vectors << " # number of training documents \n"
+	      << support_vectors + 1 << " # number of support vectors plus 1 \n"
+	      << "0 # threshold b, each following line is a SV (starting with alpha*y)\n" << lines;
+	return(model.str());
+}
+
+int main(){
+
+	char base[] = "/tmp/cascade_testXXXXXX";
+	if (!mkdtemp(base)) return 1;
+	string dir = base;
+
+	// The full model scores feature 1 and the prefilter feature 2.
+	// With -s 2 examples 0, 2 and 4 are scored by both: the positives
+	// among them have prefilter scores 0.5 and 0.75, so with -r 1 the
+	// threshold is 0.5. Example 1 is rejected with its negative
+	// prefilter score, example 3 with 0 for its positive one, and
+	// example 5 passes on to the full model.
+	write_file(dir + "/full.model", linear_model(1, "1 1:1 #\n"));
+	write_file(dir + "/prefilter.model", linear_model(1, "1 2:1 #\n"));
+	write_file(dir + "/examples.dat", "1 1:1 2:0.5\n1 1:5 2:-0.75\n1 1:2 2:0.75\n-1 1:-3 2:0.25\n-1 1:-1 2:0.875\n1 1:7 2:0.625\n");
+	string classify = "bin/svm_classify -v 0 -p " + dir + "/prefilter.model -r 1 -s 2 " + dir + "/examples.dat " + dir + "/full.model " + dir + "/cascade.predictions";
+	bool ran = !system(classify.c_str());
+	check(ran && read_file(dir + "/cascade.predictions") == "1\n-0.75\n2\n0\n-1\n7\n", "rejected pairs get the lower of their prefilter score and 0");
+
+	// Without the prefilter every pair gets the full model's score
+	classify = "bin/svm_classify -v 0 " + dir + "/examples.dat " + dir + "/full.model " + dir + "/full.predictions";
+	ran = !system(classify.c_str());
+	check(ran && read_file(dir + "/full.predictions") == "1\n5\n2\n-3\n-1\n7\n", "full model alone scores every pair");
+
+	// Reduced to the support vector of largest weight, the model only
+	// reads feature 1, with that vector's weight
+	write_file(dir + "/three.model", linear_model(3, "0.5 2:1 #\n-3 1:1 #\n1 2:2 #\n"));
+	string reduce = "bin/svm_reduce -v 0 -n 1 " + dir + "/three.model " + dir + "/reduced.model";
+	classify = "bin/svm_classify -v 0 " + dir + "/examples.dat " + dir + "/reduced.model " + dir + "/reduced.predictions";
+	ran = !system(reduce.c_str()) && !system(classify.c_str());
+	check(ran && read_file(dir + "/reduced.predictions") == "-3\n-15\n-6\n9\n3\n-21\n", "reduced model keeps the largest support vector");
+
+	string clean = "rm -rf " + dir;
+	if (system(clean.c_str())) return 1;
+	return(failures ? 1 : 0);
+}
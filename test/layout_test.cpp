@@ -0,0 +1,659 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Tests of the layout library with its thread pools
+// nested in each other. Each run must give the same arrangements as a
+// run on one thread. Built with the address sanitizer by make test.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <boost/graph/adjacency_list.hpp>
+#include <boost/graph/simple_point.hpp>
+#include "kamada_kawai_spring_layout.h"
+#include "mempack_layout.h"
+#include "draw_graphs.h"
+#include "kk_layout.h"
+#include "stress_layout.h"
+#include "rotation_dp.h"
+#include "layout_cache.h"
+#include "work_queue.h"
+#include "scheduler.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char* test){
+
+	cout << (ok ? "ok      " : "FAILED  ") << test << endl;
+	if (!ok) failures++;
+}
+
+// Eight helices of 21 residues with three contacts between each pair
+// of helices in contact, giving seven arrangements
+static void protein(vector<int>& boundaries, vector<layout_contact>& contacts){
+
+	int edges[][2] = {{0,1},{0,2},{0,3},{1,4},{2,4},{3,4},{4,5},{5,6},{5,7},{6,7}};
+	boundaries.clear();
+	contacts.clear();
+	for (int h = 0; h < 8; h++){
+		boundaries.push_back(10 + 30*h);
+		boundaries.push_back(30 + 30*h);
+	}
+	for (unsigned int e = 0; e < sizeof(edges)/sizeof(edges[0]); e++){
+		for (int k = 0; k < 3; k++){
+			layout_contact c = {boundaries[2*edges[e][0]] + 3 + 7*k, boundaries[2*edges[e][1]] + 5 + 6*k, edges[e][0]+1, edges[e][1]+1};
+			contacts.push_back(c);
+		}
+	}
+}
+
+// The arrangements of a run, as kk_plot prints them
+static string layout(const layout_options& options){
+
+	vector<int> boundaries;
+	vector<layout_contact> contacts;
+	protein(boundaries, contacts);
+	layout_result result;
+	ostringstream log, tables;
+	string error;
+	if (!mempack_layout(boundaries, contacts, options, result, log, error)) return(error);
+	write_layout_result(tables, result);
+	return(tables.str());
+}
+
+// The protein() helices with a triangle of three more helices, not in
+// contact with them, in between: each component is laid out and scored
+// as it is on its own
+static bool components_on_their_own(layout_options options){
+
+	int triangle[] = {1, 4, 8};
+	int others[] = {0, 2, 3, 5, 6, 7, 9, 10};
+	vector<int> boundaries, alone_boundaries;
+	vector<layout_contact> contacts, alone_contacts;
+	protein(alone_boundaries, alone_contacts);
+	for (int h = 0; h < 11; h++){
+		boundaries.push_back(10 + 30*h);
+		boundaries.push_back(30 + 30*h);
+	}
+	for (unsigned int c = 0; c < alone_contacts.size(); c++){
+		int h1 = others[alone_contacts[c].helix1-1], h2 = others[alone_contacts[c].helix2-1];
+		layout_contact moved = {alone_contacts[c].residue1 - alone_boundaries[2*(alone_contacts[c].helix1-1)] + boundaries[2*h1],
+		                        alone_contacts[c].residue2 - alone_boundaries[2*(alone_contacts[c].helix2-1)] + boundaries[2*h2], h1+1, h2+1};
+		contacts.push_back(moved);
+	}
+	for (int i = 0; i < 3; i++){
+		int h1 = triangle[i], h2 = triangle[(i+1) % 3];
+		for (int k = 0; k < 3; k++){
+			layout_contact c = {boundaries[2*h1] + 3 + 7*k, boundaries[2*h2] + 5 + 6*k, h1+1, h2+1};
+			contacts.push_back(c);
+		}
+	}
+
+	layout_result together, alone;
+	ostringstream log;
+	string error;
+	if (!mempack_layout(boundaries, contacts, options, together, log, error) || together.components.size() != 2) return false;
+	if (!mempack_layout(alone_boundaries, alone_contacts, options, alone, log, error) || alone.components.size() != 1) return false;
+
+	// The component holding helix 1 is the protein() one, its helices
+	// renumbered as they are on their own. Scores are per helix contact
+	// of the whole protein, 13 with the triangle and 10 without.
+	const layout_component& component = together.components[0];
+	const layout_component& other = together.components[1];
+	if (component.arrangements.size() != alone.components[0].arrangements.size()) return false;
+	for (unsigned int a = 0; a < component.arrangements.size(); a++){
+		const layout_arrangement& x = component.arrangements[a];
+		const layout_arrangement& y = alone.components[0].arrangements[a];
+		if (fabs(x.score*13 - y.score*10) > 1e-9 * y.score || x.helices.size() != y.helices.size()) return false;
+		for (unsigned int i = 0; i < x.helices.size(); i++){
+			if (x.helices[i].helix != others[y.helices[i].helix-1]+1 || x.helices[i].x != y.helices[i].x ||
+			    x.helices[i].y != y.helices[i].y || x.helices[i].rotation != y.helices[i].rotation) return false;
+		}
+	}
+	for (unsigned int a = 0; a < other.arrangements.size(); a++){
+		if (other.arrangements[a].helices.size() != 3) return false;
+		for (unsigned int i = 0; i < 3; i++){
+			if (other.arrangements[a].helices[i].helix != triangle[i]+1) return false;
+		}
+	}
+	return(!other.arrangements.empty());
+}
+
+// The rotations of every arrangement give the score reported with them
+static bool rotations_give_scores(const layout_options& options){
+
+	vector<int> boundaries;
+	vector<layout_contact> helix_contacts;
+	protein(boundaries, helix_contacts);
+	layout_result result;
+	ostringstream log;
+	string error;
+	if (!mempack_layout(boundaries, helix_contacts, options, result, log, error) || result.components.size() != 1) return false;
+
+	vector<pair<int,int> > contacts;
+	vector<pair<int,int> > helix_pairs;
+	for (unsigned int c = 0; c < helix_contacts.size(); c++){
+		contacts.push_back(make_pair(helix_contacts[c].residue1, helix_contacts[c].residue2));
+		helix_pairs.push_back(make_pair(helix_contacts[c].helix1, helix_contacts[c].helix2));
+	}
+	sort(contacts.begin(), contacts.end());
+	sort(helix_pairs.begin(), helix_pairs.end());
+	helix_pairs.erase(unique(helix_pairs.begin(), helix_pairs.end()), helix_pairs.end());
+
+	const vector<layout_arrangement>& arrangements = result.components[0].arrangements;
+	for (unsigned int a = 0; a < arrangements.size(); a++){
+		xy_array positions;
+		positions.resize(8);
+		vector<int> rotations(8), cached(8);
+		for (unsigned int i = 0; i < arrangements[a].helices.size(); i++){
+			const placed_helix& h = arrangements[a].helices[i];
+			positions.x[h.helix-1] = h.x;
+			positions.y[h.helix-1] = h.y;
+			rotations[h.helix-1] = h.rotation;
+		}
+		rotation_tables tables;
+		prepare_rotation_tables(tables, positions, boundaries, contacts, boundaries.back()+1);
+		vector<double> dist(contacts.size());
+		double score = update_rotation_score(tables, &rotations[0], &cached[0], &dist[0], false)/helix_pairs.size();
+		if (fabs(score - arrangements[a].score) > 1e-5*score) return false;
+	}
+	return true;
+}
+
+// Six helices each in contact with every other. The spring layout
+// keeps them on the regular hexagon they start from, and any two can
+// take each other's places.
+static bool symmetric_arrangements_once(){
+
+	const int n = 6;
+	vector<int> boundaries;
+	vector<layout_contact> contacts;
+	for (int h = 0; h < n; h++){
+		boundaries.push_back(10 + 30*h);
+		boundaries.push_back(30 + 30*h);
+	}
+	for (int h = 0; h < n; h++){
+		for (int j = h+1; j < n; j++){
+			layout_contact c = {boundaries[2*h] + 3 + 2*j, boundaries[2*j] + 5 + 2*h, h+1, j+1};
+			contacts.push_back(c);
+		}
+	}
+	layout_options options;
+	options.seed = 1;
+	options.threads = 1;
+	options.optimiser = OPTIMISER_CD;
+	layout_result result;
+	ostringstream log;
+	string error;
+	if (!mempack_layout(boundaries, contacts, options, result, log, error) || result.components.size() != 1) return false;
+
+	// Helix positions of each arrangement, by helix
+	const vector<layout_arrangement>& arrangements = result.components[0].arrangements;
+	vector<vector<pair<double,double> > > at(arrangements.size(), vector<pair<double,double> >(n));
+	for (unsigned int a = 0; a < arrangements.size(); a++){
+		for (unsigned int i = 0; i < arrangements[a].helices.size(); i++){
+			const placed_helix& h = arrangements[a].helices[i];
+			at[a][h.helix-1] = make_pair(h.x, h.y);
+		}
+	}
+	double cx = 0, cy = 0;
+	for (int h = 0; h < n; h++){
+		cx += at[0][h].first/n;
+		cy += at[0][h].second/n;
+	}
+
+	// Arrangement b is an image of arrangement a if the rotation or
+	// mirror taking helix 1 of a to helix 1 of b takes every helix there
+	for (unsigned int a = 0; a < at.size(); a++){
+		for (unsigned int b = a+1; b < at.size(); b++){
+			double from = atan2(at[a][0].second - cy, at[a][0].first - cx);
+			double to = atan2(at[b][0].second - cy, at[b][0].first - cx);
+			for (int mirror = 0; mirror < 2; mirror++){
+				bool image = true;
+				for (int h = 0; h < n && image; h++){
+					double r = hypot(at[a][h].first - cx, at[a][h].second - cy);
+					double angle = atan2(at[a][h].second - cy, at[a][h].first - cx);
+					angle = mirror ? from + to - angle : angle + to - from;
+					image = hypot(cx + r*cos(angle) - at[b][h].first, cy + r*sin(angle) - at[b][h].second) < 1e-3;
+				}
+				if (image) return false;
+			}
+		}
+	}
+	return(at.size() > 1);
+}
+
+// Contacts of the test protein as the layout keeps them, helix centres
+// on a circle
+static void engine_input(vector<int>& boundaries, vector<pair<int,int> >& contacts, xy_array& positions){
+
+	vector<layout_contact> helix_contacts;
+	protein(boundaries, helix_contacts);
+	contacts.clear();
+	for (unsigned int c = 0; c < helix_contacts.size(); c++) contacts.push_back(make_pair(helix_contacts[c].residue1, helix_contacts[c].residue2));
+	sort(contacts.begin(), contacts.end());
+	positions.resize(8);
+	for (int h = 0; h < 8; h++){
+		positions.x[h] = 300*cos(h*M_PI/4);
+		positions.y[h] = 300*sin(h*M_PI/4);
+	}
+}
+
+// The dp optimiser finds the lowest score of an exhaustive search over
+// the same rotation bins
+static bool dp_matches_exhaustive_search(int bins){
+
+	vector<int> boundaries;
+	vector<pair<int,int> > contacts;
+	xy_array positions;
+	engine_input(boundaries, contacts, positions);
+	rotation_tables tables;
+	prepare_rotation_tables(tables, positions, boundaries, contacts, boundaries.back()+1);
+	const int helices = 8;
+	vector<int> rotations(helices), cached(helices);
+	vector<double> dist(contacts.size());
+	int width;
+	long evaluations;
+	if (!optimise_rotation_dp(tables, helices, bins, 3, &rotations[0], width, evaluations)) return false;
+	double dp = update_rotation_score(tables, &rotations[0], &cached[0], &dist[0], false);
+
+	double best = -1;
+	vector<int> bin(helices, 0);
+	for (;;){
+		for (int h = 0; h < helices; h++) rotations[h] = bin[h]*360/bins;
+		double score = update_rotation_score(tables, &rotations[0], &cached[0], &dist[0], false);
+		if (best < 0 || score < best) best = score;
+		int h = 0;
+		while (h < helices && ++bin[h] == bins) bin[h++] = 0;
+		if (h == helices) break;
+	}
+	return(fabs(dp - best) <= 1e-9 * best);
+}
+
+// Rotation sets scored lanes at a time by batch_rotation_scores get
+// exactly the scores and contact distances of update_rotation_score
+static bool batch_scores_exact(int lanes){
+
+	vector<int> boundaries;
+	vector<pair<int,int> > contacts;
+	xy_array positions;
+	engine_input(boundaries, contacts, positions);
+	rotation_tables tables;
+	prepare_rotation_tables(tables, positions, boundaries, contacts, boundaries.back()+1);
+
+	Rng rng;
+	rng_seed(&rng, lanes);
+	vector<vector<int> > rotations(lanes, vector<int>(8));
+	vector<vector<double> > dist(lanes, vector<double>(contacts.size()));
+	vector<const int*> rotation_lanes(lanes);
+	vector<double*> dist_lanes(lanes);
+	for (int k = 0; k < lanes; k++){
+		for (int h = 0; h < 8; h++) rotations[k][h] = (int)(uni64(&rng) * 360);
+		rotation_lanes[k] = &rotations[k][0];
+		dist_lanes[k] = &dist[k][0];
+	}
+	vector<double> scores(lanes);
+	batch_rotation_scores(tables, &rotation_lanes[0], &dist_lanes[0], lanes, &scores[0]);
+
+	vector<int> cached(8);
+	vector<double> single(contacts.size());
+	for (int k = 0; k < lanes; k++){
+		if (update_rotation_score(tables, &rotations[k][0], &cached[0], &single[0], false) != scores[k] || single != dist[k]) return false;
+	}
+	return true;
+}
+
+// Score, rotations and messages of one engine
+static string run_engine(const optimiser_settings& settings, unsigned long long seed){
+
+	vector<int> boundaries;
+	vector<pair<int,int> > contacts;
+	xy_array positions;
+	engine_input(boundaries, contacts, positions);
+	Engine* e = engine_new(settings, positions, boundaries, contacts, boundaries.back()+1, seed);
+	string report;
+	ostringstream os;
+	os << engine_run(e, 1, report);
+	vector<int> rotations(8);
+	engine_best(e, &rotations[0]);
+	engine_free(e);
+	for (int h = 0; h < 8; h++) os << " " << rotations[h];
+	os << endl << report;
+	return(os.str());
+}
+
+typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::undirectedS, boost::no_property, boost::property<boost::edge_weight_t, double> > kk_graph;
+typedef vector<boost::simple_point<double> > kk_positions;
+
+// The fast Kamada-Kawai layout gives exactly the positions of the
+// Boost one, from the same starting positions
+static bool kk_engines_agree(unsigned int vertices, const vector<pair<int,int> >& edges, unsigned long long seed){
+
+	kk_graph g(vertices);
+	for (unsigned int e = 0; e < edges.size(); e++) boost::put(boost::edge_weight, g, boost::add_edge(edges[e].first, edges[e].second, g).first, 1.2);
+
+	Rng rng;
+	rng_seed(&rng, seed);
+	kk_positions boost_positions(vertices);
+	vector<double> x(vertices), y(vertices);
+	for (unsigned int v = 0; v < vertices; v++){
+		x[v] = boost_positions[v].x = uni64(&rng) * 100;
+		y[v] = boost_positions[v].y = uni64(&rng) * 100;
+	}
+
+	boost::iterator_property_map<kk_positions::iterator, boost::property_map<kk_graph, boost::vertex_index_t>::type> position(boost_positions.begin(), boost::get(boost::vertex_index, g));
+	if (!boost::kamada_kawai_spring_layout(g, position, boost::get(boost::edge_weight, g), boost::edge_length(10.0))) return false;
+	int iterations;
+	if (!uniform_kamada_kawai_layout(vertices, edges, 1.2, 10.0, &x[0], &y[0], KK_MAX_ITERATIONS, iterations)) return false;
+
+	for (unsigned int v = 0; v < vertices; v++){
+		if (x[v] != boost_positions[v].x || y[v] != boost_positions[v].y) return false;
+	}
+	return true;
+}
+
+// A ring, a 4 by 3 grid, the graph of protein() and a random
+// connected graph
+static void test_graphs(vector<unsigned int>& vertices, vector<vector<pair<int,int> > >& graphs){
+
+	vector<pair<int,int> > ring, grid, helices, random_graph;
+	for (int v = 0; v < 9; v++) ring.push_back(make_pair(v, (v+1) % 9));
+	for (int r = 0; r < 3; r++){
+		for (int c = 0; c < 4; c++){
+			if (c < 3) grid.push_back(make_pair(4*r + c, 4*r + c + 1));
+			if (r < 2) grid.push_back(make_pair(4*r + c, 4*r + c + 4));
+		}
+	}
+	int edges[][2] = {{0,1},{0,2},{0,3},{1,4},{2,4},{3,4},{4,5},{5,6},{5,7},{6,7}};
+	for (unsigned int e = 0; e < sizeof(edges)/sizeof(edges[0]); e++) helices.push_back(make_pair(edges[e][0], edges[e][1]));
+	Rng rng;
+	rng_seed(&rng, 11);
+	for (int v = 1; v < 20; v++){
+		random_graph.push_back(make_pair((int)(uni64(&rng) * v), v));
+		if (uni64(&rng) < 0.5) random_graph.push_back(make_pair((int)(uni64(&rng) * v), v));
+	}
+
+	unsigned int sizes[] = {9, 12, 8, 20};
+	vertices.assign(sizes, sizes + 4);
+	graphs.clear();
+	graphs.push_back(ring);
+	graphs.push_back(grid);
+	graphs.push_back(helices);
+	graphs.push_back(random_graph);
+}
+
+static bool kk_engines_agree(){
+
+	vector<unsigned int> vertices;
+	vector<vector<pair<int,int> > > graphs;
+	test_graphs(vertices, graphs);
+	bool agree = true;
+	for (unsigned long long seed = 1; seed <= 3; seed++){
+		for (unsigned int g = 0; g < graphs.size(); g++) agree = agree && kk_engines_agree(vertices[g], graphs[g], seed);
+	}
+	return(agree);
+}
+
+// Each smacof iteration lowers the spring energy: the layouts after
+// 1, 2, ... iterations from the same start have falling energies
+static bool stress_falls(){
+
+	vector<unsigned int> vertices;
+	vector<vector<pair<int,int> > > graphs;
+	test_graphs(vertices, graphs);
+	for (unsigned int g = 0; g < graphs.size(); g++){
+		Rng rng;
+		rng_seed(&rng, g + 1);
+		vector<double> start_x(vertices[g]), start_y(vertices[g]);
+		for (unsigned int v = 0; v < vertices[g]; v++){
+			start_x[v] = uni64(&rng) * 100;
+			start_y[v] = uni64(&rng) * 100;
+		}
+		double first, last;
+		if (!kamada_kawai_energy(vertices[g], graphs[g], 1.2, 10.0, &start_x[0], &start_y[0], first)) return false;
+		last = first;
+		for (int cap = 1; cap <= 30; cap++){
+			vector<double> x(start_x), y(start_y);
+			int iterations;
+			double energy, spring_energy;
+			if (!stress_majorisation_layout(vertices[g], graphs[g], 1.2, 10.0, &x[0], &y[0], 0, cap, iterations, energy)) return false;
+			if (!kamada_kawai_energy(vertices[g], graphs[g], 1.2, 10.0, &x[0], &y[0], spring_energy)) return false;
+			if (spring_energy > last * (1 + 1e-12)) return false;
+			last = spring_energy;
+		}
+		if (last >= first) return false;
+	}
+	return true;
+}
+
+// Edges of a graph in canonical order, each with its lower end first
+static vector<pair<int,int> > canonical_edges(const vector<pair<int,int> >& edges, const vector<int>& canon){
+
+	vector<pair<int,int> > renumbered;
+	for (unsigned int e = 0; e < edges.size(); e++){
+		int a = canon[edges[e].first], b = canon[edges[e].second];
+		renumbered.push_back(make_pair(min(a, b), max(a, b)));
+	}
+	sort(renumbered.begin(), renumbered.end());
+	return(renumbered);
+}
+
+// Renumbering the vertices of a graph at random gives the same
+// canonical key and the same graph in canonical order
+static bool canonical_labels_invariant(){
+
+	vector<unsigned int> vertices;
+	vector<vector<pair<int,int> > > graphs;
+	test_graphs(vertices, graphs);
+
+	// The six helices of symmetric_arrangements_once, every one in
+	// contact with every other
+	vector<pair<int,int> > complete;
+	for (int h = 0; h < 6; h++){
+		for (int j = h+1; j < 6; j++) complete.push_back(make_pair(h, j));
+	}
+	vertices.push_back(6);
+	graphs.push_back(complete);
+
+	Rng rng;
+	rng_seed(&rng, 5);
+	for (unsigned int g = 0; g < graphs.size(); g++){
+		vector<int> canon;
+		string key;
+		if (!canonical_labelling(vertices[g], graphs[g], canon, key)) return false;
+		vector<pair<int,int> > expected = canonical_edges(graphs[g], canon);
+		for (int trial = 0; trial < 5; trial++){
+			vector<int> relabel(vertices[g]);
+			for (unsigned int v = 0; v < vertices[g]; v++) relabel[v] = v;
+			for (unsigned int v = vertices[g]-1; v > 0; v--) swap(relabel[v], relabel[(int)(uni64(&rng) * (v+1))]);
+			vector<pair<int,int> > edges;
+			for (unsigned int e = 0; e < graphs[g].size(); e++) edges.push_back(make_pair(relabel[graphs[g][e].first], relabel[graphs[g][e].second]));
+			vector<int> other_canon;
+			string other_key;
+			if (!canonical_labelling(vertices[g], edges, other_canon, other_key)) return false;
+			if (other_key != key || canonical_edges(edges, other_canon) != expected) return false;
+		}
+	}
+	return true;
+}
+
+// Number of lines of file and whether one starts with key
+static unsigned int cache_lines(const string& file, const string& key, bool& found){
+
+	ifstream is(file.c_str());
+	string line;
+	unsigned int lines = 0;
+	found = false;
+	while (getline(is, line)){
+		lines++;
+		if (line.compare(0, key.size() + 1, key + " ") == 0) found = true;
+	}
+	return(lines);
+}
+
+// The cache files are only written by save_layout_caches, which keeps
+// what another process wrote to them after they were read
+static bool caches_merged(layout_options options){
+
+	char dir[] = "/tmp/layout_testXXXXXX";
+	if (!mkdtemp(dir)) return false;
+	options.rotation_cache = string(dir) + "/rotations";
+	options.layout_cache = string(dir) + "/layouts";
+	layout(options);
+	bool unwritten = access(options.rotation_cache.c_str(), F_OK) && access(options.layout_cache.c_str(), F_OK);
+
+	ofstream(options.rotation_cache.c_str()) << "other 1 2 3" << endl;
+	ofstream(options.layout_cache.c_str()) << "other 0.5 1.5" << endl;
+	ostringstream log;
+	bool saved = save_layout_caches(log);
+	bool rotations_kept, layouts_kept;
+	unsigned int rotations = cache_lines(options.rotation_cache, "other", rotations_kept);
+	unsigned int layouts = cache_lines(options.layout_cache, "other", layouts_kept);
+
+	remove(options.rotation_cache.c_str());
+	remove(options.layout_cache.c_str());
+	remove((options.rotation_cache + ".lock").c_str());
+	remove((options.layout_cache + ".lock").c_str());
+	rmdir(dir);
+	return(unwritten && saved && rotations_kept && layouts_kept && rotations > 1 && layouts > 1);
+}
+
+int main(){
+
+	layout_options options;
+	options.seed = 1;
+	options.threads = 1;
+	string expected = layout(options);
+	check(expected.find("Arrangement 7") != string::npos, "seven arrangements on one thread");
+	check(rotations_give_scores(options), "ga rotations give the reported scores");
+	options.optimiser = OPTIMISER_CD;
+	check(rotations_give_scores(options), "cd rotations give the reported scores");
+	options.optimiser = OPTIMISER_GA;
+	check(symmetric_arrangements_once(), "rotated and mirrored arrangements counted once");
+	options.optimiser = OPTIMISER_DP;
+	check(components_on_their_own(options), "components laid out as on their own");
+	options.optimiser = OPTIMISER_GA;
+	check(dp_matches_exhaustive_search(4) && dp_matches_exhaustive_search(5), "dp finds the best rotations of an exhaustive search");
+	check(batch_scores_exact(ROTATION_LANES) && batch_scores_exact(5), "batch scores are exactly the incremental ones");
+	check(kk_engines_agree(), "fast and Boost Kamada-Kawai layouts agree");
+	check(stress_falls(), "smacof energy falls at every iteration");
+	options.engine = LAYOUT_KK;
+	check(layout(options) == expected, "fast and Boost layout engines give the same arrangements");
+	options.engine = LAYOUT_FAST;
+
+	// Engines with different ga settings running at once give what
+	// each gives on its own
+	{
+		vector<optimiser_settings> settings(4);
+		settings[1].ga.poolsize = 20;
+		settings[2].ga.mutrate = 0.3;
+		settings[2].ga.adaptive = 1;
+		settings[3].ga.poolsize = 80;
+		settings[3].ga_eval = GA_EVAL_BATCH;
+		vector<string> alone(settings.size()), together(settings.size());
+		for (unsigned int k = 0; k < settings.size(); k++) alone[k] = run_engine(settings[k], 7);
+		work_queue pool(settings.size());
+		for (unsigned int k = 0; k < settings.size(); k++){
+			pool.push([&settings, &together, k](){ together[k] = run_engine(settings[k], 7); });
+		}
+		pool.wait();
+		bool differ = alone[0] != alone[1] && alone[0] != alone[2] && alone[0] != alone[3];
+		check(alone == together && differ, "engines with their own ga settings at once");
+	}
+
+	// More threads than arrangements: each arrangement scores its ga
+	// generations on a pool of its own, pushed to from workers of the
+	// arrangement pool with higher numbers than it has workers
+	options.threads = 16;
+	check(layout(options) == expected, "ga pools inside the arrangement pool");
+
+	// Layouts with different settings running at once give what each
+	// gives on its own
+	{
+		vector<layout_options> settings(4, options);
+		settings[1].optimiser = OPTIMISER_CD;
+		settings[2].optimiser = OPTIMISER_DP;
+		settings[3].engine = LAYOUT_SMACOF;
+		settings[3].threads = 2;
+		vector<string> alone(settings.size()), together(settings.size());
+		for (unsigned int k = 0; k < settings.size(); k++) alone[k] = layout(settings[k]);
+		vector<thread> threads;
+		for (unsigned int k = 0; k < settings.size(); k++){
+			threads.push_back(thread([&settings, &together, k](){ together[k] = layout(settings[k]); }));
+		}
+		for (unsigned int k = 0; k < threads.size(); k++) threads[k].join();
+		check(alone == together, "layouts with different settings at once");
+	}
+
+	// Layouts called from the workers of another pool, as mempack_batch
+	// does, each running its starts on a pool of its own
+	options.starts = 3;
+	options.threads = 1;
+	expected = layout(options);
+	options.threads = 2;
+	{
+		vector<string> runs(4);
+		work_queue pool(4);
+		for (unsigned int k = 0; k < runs.size(); k++){
+			pool.push([&runs, &options, k](){ runs[k] = layout(options); });
+		}
+		pool.wait();
+		bool same = true;
+		for (unsigned int k = 0; k < runs.size(); k++) same = same && runs[k] == expected;
+		check(same, "layout starts inside the workers of another pool");
+	}
+
+	// Layouts as mempack_batch runs them: one stage scheduler task of
+	// one core each, several at once
+	options.threads = 1;
+	{
+		vector<string> runs(8);
+		stage_scheduler scheduler(4);
+		for (unsigned int k = 0; k < runs.size(); k++){
+			stage_task plot;
+			ostringstream name;
+			name << "layout " << k;
+			plot.name = name.str();
+			plot.stage = "layout";
+			plot.outputs.push_back(plot.name);
+			plot.priority = k;
+			plot.cores = 1;
+			plot.run = [&runs, options, k](unsigned int, unsigned int){
+				runs[k] = layout(options);
+				return true;
+			};
+			scheduler.add(plot);
+		}
+		scheduler.run();
+		bool same = true;
+		for (unsigned int k = 0; k < runs.size(); k++) same = same && runs[k] == expected;
+		check(same, "layout starts inside stage scheduler tasks");
+	}
+
+	check(canonical_labels_invariant(), "canonical labels invariant under renumbering");
+	check(caches_merged(options), "cache files merged with other writers");
+
+	return(failures ? 1 : 0);
+}
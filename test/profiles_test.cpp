@@ -0,0 +1,136 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Tests of profile generation with stub blastpgp and
+// makemat scripts, in directories whose names need quoting in a shell
+// command. Built with the address sanitizer by make test.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "profiles.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char* test){
+
+	cout << (ok ? "ok      " : "FAILED  ") << test << endl;
+	if (!ok) failures++;
+}
+
+static void write_file(const string& file, const string& text, mode_t mode){
+
+	ofstream os(file.c_str());
+	os << text;
+	os.close();
+	chmod(file.c_str(), mode);
+}
+
+static string read_file(const string& file){
+
+	ifstream is(file.c_str());
+	ostringstream text;
+	text << is.rdbuf();
+	return(text.str());
+}
+
+// Files in dir other than . and ..
+static unsigned int files_in(const string& dir){
+
+	unsigned int files = 0;
+	DIR* d = opendir(dir.c_str());
+	if (!d) return 0;
+	struct dirent* entry;
+	while ((entry = readdir(d))){
+		string name = entry->d_name;
+		if (name != "." && name != "..") files++;
+	}
+	closedir(d);
+	return(files);
+}
+
+int main(){
+
+	char base[] = "/tmp/profiles_testXXXXXX";
+	if (!mkdtemp(base)) return 1;
+	string dir = string(base) + "/a dir's name";
+	string ncbi = dir + "/ncbi tools", cache = dir + "/cache", tmp = dir + "/tmp";
+	mkdir(dir.c_str(), 0755);
+	mkdir(ncbi.c_str(), 0755);
+	mkdir(cache.c_str(), 0755);
+	mkdir(tmp.c_str(), 0755);
+	write_file(dir + "/db.pin", "", 0644);
+
+	// The stubs log each search, and makemat fails with half a profile
+	// written while the file fail exists. Paths reach them in single
+	// quotes, with the quote of the directory name escaped.
+	string quoted = "'" + string(base) + "/a dir'\\''s name";
+	write_file(ncbi + "/blastpgp",
+	           "#!/bin/sh\n"
+	           "db=\n"
+	           "while [ $# -gt 0 ]; do\n"
+	           "\tif [ \"$1\" = -d ]; then db=\"$2\"; fi\n"
+	           "\tshift\n"
+	           "done\n"
+	           "[ -f \"$db.pin\" ] || exit 1\n"
+	           "echo search >> " + quoted + "/searches'\n"
+	           ": > mempack_tmp.chk\n", 0755);
+	write_file(ncbi + "/makemat",
+	           "#!/bin/sh\n"
+	           "if [ -f " + quoted + "/fail' ]; then echo 20 > mempack_tmp.mtx; exit 1; fi\n"
+	           "echo 20 > mempack_tmp.mtx\n"
+	           "sed -n 2p mempack_tmp.fasta >> mempack_tmp.mtx\n"
+	           "echo 0 0 0 >> mempack_tmp.mtx\n", 0755);
+	write_file(dir + "/a.fa", ">a\nMKTAYIAKQR\nQISFVKSHFS\n", 0644);
+	write_file(dir + "/b.fa", ">b\nMSEQNNTEMT\n", 0644);
+
+	search_config config;
+	config.ncbidir = ncbi;
+	config.database = dir + "/db";
+	config.cache_dir = cache;
+	config.tmp_dir = tmp;
+	bool cached;
+	string message;
+
+	bool made = make_profile(config, dir + "/a.mtx", dir + "/a.mtx", 1, cached, message);
+	check(!made, "a missing fasta file is refused");
+
+	made = make_profile(config, dir + "/a.fa", dir + "/a.mtx", 1, cached, message);
+	string profile = read_file(dir + "/a.mtx");
+	check(made && !cached && read_file(dir + "/searches") == "search\n" && profile == "20\nMKTAYIAKQRQISFVKSHFS\n0 0 0\n"
+	      && files_in(cache) == 1, "a cache miss searches and keeps the profile");
+
+	made = make_profile(config, dir + "/a.fa", dir + "/a2.mtx", 1, cached, message);
+	check(made && cached && read_file(dir + "/searches") == "search\n" && read_file(dir + "/a2.mtx") == profile,
+	      "a cache hit copies the profile without searching");
+
+	write_file(dir + "/fail", "", 0644);
+	made = make_profile(config, dir + "/b.fa", dir + "/b.mtx", 1, cached, message);
+	check(!made && access((dir + "/b.mtx").c_str(), F_OK) && files_in(cache) == 1,
+	      "no partial profile is installed when makemat fails");
+	check(files_in(tmp) == 0, "search directories are removed");
+
+	string clean = "rm -rf " + string(base);
+	if (system(clean.c_str())) return 1;
+	return(failures ? 1 : 0);
+}
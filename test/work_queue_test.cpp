@@ -0,0 +1,82 @@
+// ********************************************************
+// *   MEMPACK - Predicting transmembrane helix packing   *
+// *       arrangements using residue contacts and        *
+// *              a force-directed algorithm.             *
+// * Copyright (C) 2009 Timothy Nugent and David T. Jones *
+// ********************************************************
+//
+// This program is copyright and may not be distributed without
+// permission of the author unless specifically permitted under
+// the terms of the license agreement.
+//
+// THIS SOFTWARE MAY ONLY BE USED FOR NON-COMMERCIAL PURPOSES. PLEASE CONTACT
+// THE AUTHOR IF YOU REQUIRE A LICENSE FOR COMMERCIAL USE.
+//
+// Description: Tests of the work queue. Workers of one queue push to
+// queues of their own, as the arrangement pool does to the ga pools,
+// and to their own queue, as tasks that split into smaller tasks do.
+// Built with the address sanitizer by make test.
+//
+
+#include <iostream>
+#include <atomic>
+#include <stdlib.h>
+#include "work_queue.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char* test){
+
+	cout << (ok ? "ok      " : "FAILED  ") << test << endl;
+	if (!ok) failures++;
+}
+
+int main(){
+
+	// Outer workers with ids past the size of the inner queues
+	{
+		atomic<int> done(0);
+		work_queue outer(4);
+		for (int a = 0; a < 8; a++){
+			outer.push([&done](){
+				work_queue inner(1);
+				for (int k = 0; k < 100; k++) inner.push([&done](){ done++; });
+				inner.wait();
+			});
+		}
+		outer.wait();
+		check(done == 800, "nested queues smaller than the outer queue");
+	}
+
+	// Inner queues larger than the outer one
+	{
+		atomic<int> done(0);
+		work_queue outer(2);
+		for (int a = 0; a < 4; a++){
+			outer.push([&done](){
+				work_queue inner(3);
+				for (int k = 0; k < 100; k++) inner.push([&done](){ done++; });
+				inner.wait();
+			});
+		}
+		outer.wait();
+		check(done == 400, "nested queues larger than the outer queue");
+	}
+
+	// Tasks pushing to their own queue
+	{
+		atomic<int> done(0);
+		work_queue pool(3);
+		for (int a = 0; a < 10; a++){
+			pool.push([&done, &pool](){
+				for (int k = 0; k < 10; k++) pool.push([&done](){ done++; });
+			});
+		}
+		pool.wait();
+		check(done == 100, "tasks pushed by tasks of the same queue");
+	}
+
+	return(failures ? 1 : 0);
+}